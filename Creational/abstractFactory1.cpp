@@ -16,22 +16,94 @@
  classes are instantiated). A class can be configured with a factory object,
  which it uses to create objects, and even more, the factory object can be
  exchanged at run-time.
+
+ Every window of a toolkit repeats the same few toolkit and type names, so
+ they are interned: the StringTable keeps one copy of each distinct name and
+ a Window only stores two small ids. The accessors return a reference into
+ the table and never allocate.
+
+ A whole screen can also be requested at once with createLayout(spec): the
+ factory builds every window of the spec in a single allocation, and keeps
+ the window sizes in width and height columns so layout passes walk two
+ dense int arrays instead of chasing window pointers.
  */
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/* Process-wide table of interned names. Entries are never removed or moved,
+   so lookups need no lock even while other threads intern new names. */
+class StringTable
+{
+    public:
+        static const std::size_t capacity = 256;
+
+        static std::uint16_t intern(std::string_view s)
+        {
+            std::size_t n = count.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < n; i++)
+                if (names[i] == s) { return i; }
+            std::lock_guard<std::mutex> lock(mutex);
+            n = count.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < n; i++)
+                if (names[i] == s) { return i; }
+            if (n == capacity)
+            {
+                std::cout << "StringTable full" << std::endl;
+                std::abort();
+            }
+            names[n] = std::string(s);
+            count.store(n + 1, std::memory_order_release);
+            return n;
+        }
+        static const std::string& lookup(std::uint16_t id) { return names[id]; }
+    private:
+        static std::string names[capacity];
+        static std::atomic<std::size_t> count;
+        static std::mutex mutex;
+};
+
+std::string StringTable::names[StringTable::capacity];
+std::atomic<std::size_t> StringTable::count(0);
+std::mutex StringTable::mutex;
+
+/* Two bytes per name instead of a std::string */
+class InternedString
+{
+    public:
+        InternedString(std::string_view s) : id(StringTable::intern(s)) {}
+        const std::string& str() const { return StringTable::lookup(id); }
+    private:
+        std::uint16_t id;
+};
 
 class Window
 {
     protected:
         int width;
         int height;
-        std::string toolkit;
-        std::string type;
-        Window(std::string usedToolkit, std::string windowType)
-            : toolkit(usedToolkit), type(windowType) {}
+        InternedString toolkit;
+        InternedString type;
+        Window(std::string_view usedToolkit, std::string_view windowType)
+            : width(0), height(0), toolkit(usedToolkit), type(windowType) {}
     public:
-        std::string getToolkit() { return toolkit; }
-        std::string getType() { return type; }
+        virtual ~Window() {}
+        const std::string& getToolkit() const { return toolkit.str(); }
+        const std::string& getType() const { return type.str(); }
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        void resize(int w, int h) { width = w; height = h; }
 };
 
 class GtkToolboxWindow : public Window
@@ -70,14 +142,124 @@ class QtMainWindow : public Window
         QtMainWindow() : Window("Qt", "MainWindow") {}
 };
 
+/* How many windows of each kind a screen needs */
+struct LayoutSpec
+{
+    std::size_t toolboxWindows;
+    std::size_t layersWindows;
+    std::size_t mainWindows;
+    int screenWidth;
+    int screenHeight;
+};
+
+/*
+ A family of windows living in one block: the window objects at a fixed
+ stride, then a column of the Window* that placement new returned for each
+ slot, then the width and height columns. The windows are only ever reached
+ through those pointers, never by casting slot memory. The size columns are
+ the only copy of the sizes, so the windows themselves are not handed out:
+ layout[i] is an Entry that reads the names from the window and the size from
+ the columns.
+ */
+class Layout
+{
+    public:
+        /* One window of the layout; its size lives in the columns */
+        class Entry
+        {
+            public:
+                const std::string& getToolkit() const { return window.getToolkit(); }
+                const std::string& getType() const { return window.getType(); }
+                int getWidth() const { return width; }
+                int getHeight() const { return height; }
+                void resize(int w, int h) { width = w; height = h; }
+            private:
+                friend class Layout;
+                Entry(const Window& window, int& width, int& height)
+                    : window(window), width(width), height(height) {}
+                const Window& window;
+                int& width;
+                int& height;
+        };
+
+        Layout(Layout&& other)
+            : block(other.block), count(other.count), stride(other.stride),
+              windows(other.windows), width(other.width), height(other.height), bytes(other.bytes)
+        {
+            other.block = nullptr;
+            other.count = 0;
+        }
+        ~Layout()
+        {
+            for (std::size_t i = 0; i < count; i++)
+                windows[i]->~Window();
+            ::operator delete(block);
+        }
+        std::size_t size() const { return count; }
+        Entry operator[](std::size_t i) { return Entry(*windows[i], width[i], height[i]); }
+        int* widths() { return width; }
+        int* heights() { return height; }
+        std::size_t allocatedBytes() const { return bytes; }
+    private:
+        friend class UIFactory;
+        Layout(std::size_t n, std::size_t stride) : count(0), stride(stride)
+        {
+            /* stride is a multiple of the windows' alignment, which is at
+               least a pointer's, so the columns that follow stay aligned */
+            bytes = n * (stride + sizeof(Window*) + 2 * sizeof(int));
+            block = static_cast<char*>(::operator new(bytes));
+            windows = new (block + n * stride) Window*[n];
+            width = new (windows + n) int[n];
+            height = width + n;
+        }
+        template <class W>
+        void add(int w, int h)
+        {
+            windows[count] = new (block + count * stride) W();
+            width[count] = w;
+            height[count] = h;
+            count++;
+        }
+
+        char* block;
+        std::size_t count;
+        std::size_t stride;
+        Window** windows;
+        int* width;
+        int* height;
+        std::size_t bytes;
+};
 
 /* Abstract Factory */
 class UIFactory
 {
     public:
+        virtual ~UIFactory() {}
         virtual Window* getToolboxWindow() = 0;
         virtual Window* getLayersWindow()  = 0;
         virtual Window* getMainWindow()    = 0;
+        /* Builds every window of the spec with one allocation */
+        virtual Layout createLayout(const LayoutSpec& spec) = 0;
+    protected:
+        template <class Toolbox, class Layers, class Main>
+        static Layout buildLayout(const LayoutSpec& spec)
+        {
+            const std::size_t align = std::max({ alignof(Toolbox), alignof(Layers), alignof(Main) });
+            std::size_t stride = std::max({ sizeof(Toolbox), sizeof(Layers), sizeof(Main) });
+            stride = (stride + align - 1) / align * align;
+            std::size_t n = spec.toolboxWindows + spec.layersWindows + spec.mainWindows;
+            Layout layout(n, stride);
+
+            /* main windows fill the screen, docks share a side column */
+            int docks = std::max<std::size_t>(1, spec.toolboxWindows + spec.layersWindows);
+            for (std::size_t i = 0; i < spec.mainWindows; i++)
+                layout.add<Main>(spec.screenWidth, spec.screenHeight);
+            for (std::size_t i = 0; i < spec.toolboxWindows; i++)
+                layout.add<Toolbox>(64, spec.screenHeight / docks);
+            for (std::size_t i = 0; i < spec.layersWindows; i++)
+                layout.add<Layers>(240, spec.screenHeight / docks);
+            return layout;
+        }
 };
 
 /* Factory for Gtk toolkit */
@@ -87,6 +269,10 @@ class GtkUIFactory : public UIFactory
         Window* getToolboxWindow()  { return new GtkToolboxWindow(); }
         Window* getLayersWindow()   { return new GtkLayersWindow(); }
         Window* getMainWindow()     { return new GtkMainWindow(); }
+        Layout createLayout(const LayoutSpec& spec)
+        {
+            return buildLayout<GtkToolboxWindow, GtkLayersWindow, GtkMainWindow>(spec);
+        }
 };
 
 /* Factory for Qt toolkit */
@@ -96,8 +282,131 @@ class QtUIFactory : public UIFactory
         Window* getToolboxWindow()  { return new QtToolboxWindow(); }
         Window* getLayersWindow()   { return new QtLayersWindow(); }
         Window* getMainWindow()     { return new QtMainWindow(); }
+        Layout createLayout(const LayoutSpec& spec)
+        {
+            return buildLayout<QtToolboxWindow, QtLayersWindow, QtMainWindow>(spec);
+        }
 };
 
+/* Previous Window layout, kept for the before/after measurement only */
+class StringWindow
+{
+    public:
+        StringWindow(std::string usedToolkit, std::string windowType)
+            : toolkit(usedToolkit), type(windowType) {}
+        std::string getToolkit() { return toolkit; }
+        std::string getType() { return type; }
+    private:
+        int width;
+        int height;
+        std::string toolkit;
+        std::string type;
+};
+
+/* Creates n windows with make() and reads both names of each with read() */
+template <class W, class Make, class Read>
+void measure(const char* name, std::size_t n, Make make, Read read)
+{
+    std::vector<W*> windows;
+    windows.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+        windows.push_back(make(i));
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t total = 0;
+    for (int pass = 0; pass < 10; pass++)
+        for (W* w : windows)
+            total += read(w);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << name << ": " << sizeof(W) << " bytes/window, "
+              << 10 * n / elapsed.count() / 1e6 << " M accessor pairs/s"
+              << " (" << total << " chars)" << std::endl;
+    for (W* w : windows)
+        delete w;
+}
+
+/* Heap bytes currently in use, where the C library can tell */
+static std::size_t heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/* Builds `screens` screens of `spec` per window and as layouts, then runs
+   a resize pass over each; prints time and heap use of both */
+static void compareLayouts(UIFactory& ui, const LayoutSpec& spec, std::size_t screens)
+{
+    typedef std::chrono::steady_clock clock;
+    std::size_t n = spec.toolboxWindows + spec.layersWindows + spec.mainWindows;
+
+    std::size_t heap0 = heapInUse();
+    auto t0 = clock::now();
+    std::vector<std::vector<Window*>> perWindow(screens);
+    int docks = std::max<std::size_t>(1, spec.toolboxWindows + spec.layersWindows);
+    for (std::vector<Window*>& screen : perWindow)
+    {
+        screen.reserve(n);
+        for (std::size_t i = 0; i < spec.mainWindows; i++)
+        {
+            screen.push_back(ui.getMainWindow());
+            screen.back()->resize(spec.screenWidth, spec.screenHeight);
+        }
+        for (std::size_t i = 0; i < spec.toolboxWindows; i++)
+        {
+            screen.push_back(ui.getToolboxWindow());
+            screen.back()->resize(64, spec.screenHeight / docks);
+        }
+        for (std::size_t i = 0; i < spec.layersWindows; i++)
+        {
+            screen.push_back(ui.getLayersWindow());
+            screen.back()->resize(240, spec.screenHeight / docks);
+        }
+    }
+    auto t1 = clock::now();
+    std::size_t heapPerWindow = heapInUse() - heap0;
+    for (std::vector<Window*>& screen : perWindow)
+        for (Window* w : screen)
+            w->resize(w->getWidth() * 3 / 2, w->getHeight() * 3 / 2);
+    auto t2 = clock::now();
+
+    std::size_t heap1 = heapInUse();
+    auto t3 = clock::now();
+    std::vector<Layout> layouts;
+    layouts.reserve(screens);
+    for (std::size_t i = 0; i < screens; i++)
+        layouts.push_back(ui.createLayout(spec));
+    auto t4 = clock::now();
+    std::size_t heapLayout = heapInUse() - heap1;
+    for (Layout& layout : layouts)
+    {
+        int* w = layout.widths();
+        int* h = layout.heights();
+        for (std::size_t i = 0; i < layout.size(); i++)
+        {
+            w[i] = w[i] * 3 / 2;
+            h[i] = h[i] * 3 / 2;
+        }
+    }
+    auto t5 = clock::now();
+
+    typedef std::chrono::duration<double, std::milli> ms;
+    std::cout << screens << " screens of " << n << " windows" << std::endl;
+    std::cout << "per-window: build " << ms(t1 - t0).count() << " ms, resize "
+              << ms(t2 - t1).count() << " ms, " << heapPerWindow / double(screens * n)
+              << " heap bytes/window" << std::endl;
+    std::cout << "layout:     build " << ms(t4 - t3).count() << " ms, resize "
+              << ms(t5 - t4).count() << " ms, " << heapLayout / double(screens * n)
+              << " heap bytes/window" << std::endl;
+
+    for (std::vector<Window*>& screen : perWindow)
+        for (Window* w : screen)
+            delete w;
+}
+
 int main()
 {
     UIFactory* ui = nullptr;
@@ -121,6 +430,34 @@ int main()
     std::cout << toolbox->getToolkit() << ":" << toolbox->getType() << std::endl;
     std::cout << layers->getToolkit() << ":" << layers->getType() << std::endl;
     std::cout << main->getToolkit() << ":" << main->getType() << std::endl;
+    std::cout << std::endl;
+
+    /* Memory and accessor cost, before and after interning */
+    const std::size_t n = 300000;
+    const char* toolkits[] = { "Gtk", "Qt" };
+    const char* types[] = { "ToolboxWindow", "LayersWindow", "MainWindow" };
+    measure<StringWindow>("std::string fields", n,
+        [&](std::size_t i) { return new StringWindow(toolkits[i % 2], types[i % 3]); },
+        [](StringWindow* w) { return w->getToolkit().size() + w->getType().size(); });
+    GtkUIFactory gtk;
+    QtUIFactory qt;
+    UIFactory* factories[] = { &gtk, &qt };
+    measure<Window>("interned fields", n,
+        [&](std::size_t i) {
+            UIFactory* f = factories[i % 2];
+            return i % 3 == 0 ? f->getToolboxWindow() : i % 3 == 1 ? f->getLayersWindow() : f->getMainWindow();
+        },
+        [](Window* w) { return w->getToolkit().size() + w->getType().size(); });
+    std::cout << std::endl;
+
+    /* A whole screen from one call */
+    LayoutSpec spec = { 8, 24, 1, 1920, 1080 };
+    Layout screen = ui->createLayout(spec);
+    screen[0].resize(1600, 900);
+    std::cout << screen.size() << " windows in " << screen.allocatedBytes()
+              << " bytes, first is " << screen[0].getToolkit() << ":" << screen[0].getType()
+              << " " << screen[0].getWidth() << "x" << screen[0].getHeight() << std::endl;
+    compareLayouts(*ui, spec, 20000);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,231 @@
+/**
+Abstract Factory with the family chosen at compile time.
+
+The classic Abstract Factory (abstractFactory.cpp) pays two virtual calls per
+product, one for the factory method and one for draw(), and every product is
+a separate heap object. When the render loop already knows which family it
+uses when it is compiled, the family can be a template parameter instead:
+
+    --A family is a traits class naming its Curved and Straight products.
+    --StaticShapeFactory<Family> creates products by value, no virtual calls.
+    --Products are kept either in per-type homogeneous containers
+    (ShapeStore<Family>), where loops over them inline and vectorize, or in a
+    std::variant when families are mixed in one container.
+
+The runtime-polymorphic path stays available: Polymorphic<P> adapts any
+product to the Shape interface and the runtime factories hand those out.
+*/
+#include <iostream>
+#include <vector>
+#include <variant>
+#include <chrono>
+#include <cstdlib>
+using namespace std;
+
+/* Concrete products: plain value types, nothing virtual */
+struct Circle {
+    float r;
+    void draw() const { cout << "circle r=" << r << ": draw" << endl; }
+    float area() const { return 3.14159265f * r * r; }
+};
+struct Square {
+    float side;
+    void draw() const { cout << "square side=" << side << ": draw" << endl; }
+    float area() const { return side * side; }
+};
+struct Ellipse {
+    float a, b;
+    void draw() const { cout << "ellipse " << a << "x" << b << ": draw" << endl; }
+    float area() const { return 3.14159265f * a * b; }
+};
+struct Rectangle {
+    float w, h;
+    void draw() const { cout << "rectangle " << w << "x" << h << ": draw" << endl; }
+    float area() const { return w * h; }
+};
+
+/* Product families known at compile time */
+struct SimpleFamily {
+    typedef Circle Curved;
+    typedef Square Straight;
+};
+struct RobustFamily {
+    typedef Ellipse Curved;
+    typedef Rectangle Straight;
+};
+
+/* Static Abstract Factory: the family is a template parameter */
+template <class Family>
+class StaticShapeFactory {
+    public:
+        typedef typename Family::Curved   Curved;
+        typedef typename Family::Straight Straight;
+
+        static Curved createCurvedInstance(float size);
+        static Straight createStraightInstance(float size);
+};
+
+template <> inline Circle StaticShapeFactory<SimpleFamily>::createCurvedInstance(float size) { return Circle{size}; }
+template <> inline Square StaticShapeFactory<SimpleFamily>::createStraightInstance(float size) { return Square{size}; }
+template <> inline Ellipse StaticShapeFactory<RobustFamily>::createCurvedInstance(float size) { return Ellipse{size, size / 2}; }
+template <> inline Rectangle StaticShapeFactory<RobustFamily>::createStraightInstance(float size) { return Rectangle{size, size / 2}; }
+
+/* Homogeneous per-type storage for one family */
+template <class Family>
+class ShapeStore {
+    public:
+        typedef StaticShapeFactory<Family> Factory;
+
+        void addCurved(float size) { curved.push_back(Factory::createCurvedInstance(size)); }
+        void addStraight(float size) { straight.push_back(Factory::createStraightInstance(size)); }
+
+        /* f is called with each product; every loop is over a single type */
+        template <class F>
+        void forEach(F f) const {
+            for (const auto& s : curved) f(s);
+            for (const auto& s : straight) f(s);
+        }
+    private:
+        vector<typename Family::Curved>   curved;
+        vector<typename Family::Straight> straight;
+};
+
+/* Mixed families in one contiguous container */
+typedef variant<Circle, Square, Ellipse, Rectangle> AnyShape;
+
+/* Runtime-polymorphic path, kept for families chosen at run-time */
+class Shape {
+    public:
+        virtual ~Shape() {}
+        virtual void draw() = 0;
+        virtual float area() = 0;
+};
+
+template <class P>
+class Polymorphic : public Shape {
+    public:
+        Polymorphic(const P& p) : product(p) {}
+        void draw() { product.draw(); }
+        float area() { return product.area(); }
+    private:
+        P product;
+};
+
+class Factory {
+    public:
+        virtual ~Factory() {}
+        virtual Shape* createCurvedInstance(float size) = 0;
+        virtual Shape* createStraightInstance(float size) = 0;
+};
+
+template <class Family>
+class RuntimeShapeFactory : public Factory {
+    public:
+        Shape* createCurvedInstance(float size) {
+            return new Polymorphic<typename Family::Curved>(StaticShapeFactory<Family>::createCurvedInstance(size));
+        }
+        Shape* createStraightInstance(float size) {
+            return new Polymorphic<typename Family::Straight>(StaticShapeFactory<Family>::createStraightInstance(size));
+        }
+};
+typedef RuntimeShapeFactory<SimpleFamily> SimpleShapeFactory;
+typedef RuntimeShapeFactory<RobustFamily> RobustShapeFactory;
+
+/* Runs f once and returns elapsed milliseconds */
+template <class F>
+double timeMs(F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    /* Same products as the runtime example, family fixed at compile time */
+    ShapeStore<SimpleFamily> simple;
+    simple.addCurved(1);
+    simple.addStraight(2);
+    simple.addCurved(3);
+    simple.forEach([](const auto& s) { s.draw(); });
+
+    ShapeStore<RobustFamily> robust;
+    robust.addCurved(4);
+    robust.addStraight(5);
+    robust.addCurved(6);
+    robust.forEach([](const auto& s) { s.draw(); });
+
+    /* Runtime path is still there */
+    Factory* factory = new SimpleShapeFactory;
+    Shape* shape = factory->createCurvedInstance(7);
+    shape->draw();
+    delete shape;
+    delete factory;
+    cout << endl;
+
+    /* Dispatch cost: build n products and sum their areas ("draw" loop) */
+    const int n = 4000000;
+    volatile float sink = 0;
+
+    vector<Shape*> heap;
+    Factory* sf = new SimpleShapeFactory;
+    Factory* rf = new RobustShapeFactory;
+    double buildVirtual = timeMs([&] {
+        heap.reserve(n);
+        for (int i = 0; i < n; i++) {
+            Factory* f = (i & 2) ? rf : sf;
+            heap.push_back((i & 1) ? f->createStraightInstance(i % 7 + 1)
+                                   : f->createCurvedInstance(i % 7 + 1));
+        }
+    });
+    double drawVirtual = timeMs([&] {
+        float total = 0;
+        for (Shape* s : heap) total += s->area();
+        sink = total;
+    });
+
+    vector<AnyShape> mixed;
+    double buildVariant = timeMs([&] {
+        mixed.reserve(n);
+        for (int i = 0; i < n; i++) {
+            float size = i % 7 + 1;
+            if (i & 2)
+                (i & 1) ? mixed.push_back(StaticShapeFactory<RobustFamily>::createStraightInstance(size))
+                        : mixed.push_back(StaticShapeFactory<RobustFamily>::createCurvedInstance(size));
+            else
+                (i & 1) ? mixed.push_back(StaticShapeFactory<SimpleFamily>::createStraightInstance(size))
+                        : mixed.push_back(StaticShapeFactory<SimpleFamily>::createCurvedInstance(size));
+        }
+    });
+    double drawVariant = timeMs([&] {
+        float total = 0;
+        for (const AnyShape& s : mixed) total += visit([](const auto& p) { return p.area(); }, s);
+        sink = total;
+    });
+
+    ShapeStore<SimpleFamily> simpleStore;
+    ShapeStore<RobustFamily> robustStore;
+    double buildStatic = timeMs([&] {
+        for (int i = 0; i < n; i++) {
+            float size = i % 7 + 1;
+            if (i & 2)
+                (i & 1) ? robustStore.addStraight(size) : robustStore.addCurved(size);
+            else
+                (i & 1) ? simpleStore.addStraight(size) : simpleStore.addCurved(size);
+        }
+    });
+    double drawStatic = timeMs([&] {
+        float total = 0;
+        simpleStore.forEach([&](const auto& s) { total += s.area(); });
+        robustStore.forEach([&](const auto& s) { total += s.area(); });
+        sink = total;
+    });
+
+    cout << n << " products, build / draw loop in ms" << endl;
+    cout << "virtual factory + virtual draw: " << buildVirtual << " / " << drawVirtual << endl;
+    cout << "static factory + std::variant:  " << buildVariant << " / " << drawVariant << endl;
+    cout << "static factory + per-type store: " << buildStatic << " / " << drawStatic << endl;
+
+    for (Shape* s : heap) delete s;
+    delete sf;
+    delete rf;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,372 @@
+/**
+Abstract Factory whose products really draw.
+
+Same families as abstractFactory.cpp (Simple: Circle/Square, Robust:
+Ellipse/Rectangle), but draw() rasterizes the shape into an in-memory RGBA
+Framebuffer instead of printing. Rendering is tile based:
+
+    --Every shape is binned into the screen tiles its bounding box touches.
+    --Tiles are independent, so they are rendered in parallel by a small
+    work-stealing pool; inside a tile shapes are drawn in creation order.
+    --Circles and ellipses test four pixels at a time against the implicit
+    distance function (SSE2 when available, scalar otherwise). Squares and
+    rectangles are axis aligned, so their edge tests reduce to clipping a
+    span, which is then filled directly.
+
+The demo scene is written to shapes.ppm. The benchmark reports shapes per
+second for each thread count; pass shape counts on the command line (e.g.
+100000 1000000 10000000), the default is 10^5 and 10^6.
+*/
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+/* RGBA pixels, R in the lowest byte */
+struct Framebuffer {
+    Framebuffer(int w, int h) : width(w), height(h), pixels(size_t(w) * h, 0xff000000u) {}
+    void clear() { fill(pixels.begin(), pixels.end(), 0xff000000u); }
+    uint32_t* row(int y) { return &pixels[size_t(y) * width]; }
+    /* binary PPM, alpha dropped */
+    void writePPM(const char* path) const {
+        ofstream out(path, ios::binary);
+        out << "P6\n" << width << " " << height << "\n255\n";
+        for (uint32_t p : pixels) {
+            char rgb[3] = { char(p & 0xff), char((p >> 8) & 0xff), char((p >> 16) & 0xff) };
+            out.write(rgb, 3);
+        }
+    }
+
+    int width, height;
+    vector<uint32_t> pixels;
+};
+
+/* Pixel rectangle [x0,x1) x [y0,y1) */
+struct Tile { int x0, y0, x1, y1; };
+
+/* Fills the part of an axis-aligned ellipse that lies inside t */
+static void fillEllipse(Framebuffer& fb, const Tile& t, float cx, float cy,
+                        float rx, float ry, uint32_t color) {
+    int ys = max(t.y0, int(floor(cy - ry))), ye = min(t.y1, int(ceil(cy + ry)));
+    int xs = max(t.x0, int(floor(cx - rx))), xe = min(t.x1, int(ceil(cx + rx)));
+    float irx = 1.0f / rx, iry = 1.0f / ry;
+    for (int py = ys; py < ye; py++) {
+        float dy = (py + 0.5f - cy) * iry;
+        float dy2 = dy * dy;
+        if (dy2 > 1.0f)
+            continue;
+        uint32_t* row = fb.row(py);
+        int px = xs;
+#if defined(__SSE2__)
+        const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128i fill = _mm_set1_epi32(int(color));
+        for (; px + 4 <= xe; px += 4) {
+            __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(px)), lane),
+                                              _mm_set1_ps(cx)), _mm_set1_ps(irx));
+            __m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_set1_ps(dy2));
+            __m128i inside = _mm_castps_si128(_mm_cmple_ps(d, one));
+            __m128i old = _mm_loadu_si128((__m128i*)(row + px));
+            __m128i out = _mm_or_si128(_mm_and_si128(inside, fill), _mm_andnot_si128(inside, old));
+            _mm_storeu_si128((__m128i*)(row + px), out);
+        }
+#endif
+        for (; px < xe; px++) {
+            float dx = (px + 0.5f - cx) * irx;
+            if (dx * dx + dy2 <= 1.0f)
+                row[px] = color;
+        }
+    }
+}
+
+/* Fills the part of an axis-aligned rectangle that lies inside t */
+static void fillRect(Framebuffer& fb, const Tile& t, float x0, float y0,
+                     float x1, float y1, uint32_t color) {
+    int ys = max(t.y0, int(lround(y0))), ye = min(t.y1, int(lround(y1)));
+    int xs = max(t.x0, int(lround(x0))), xe = min(t.x1, int(lround(x1)));
+    for (int py = ys; py < ye; py++)
+        if (xs < xe)
+            fill_n(fb.row(py) + xs, xe - xs, color);
+}
+
+class Shape {
+    public:
+        Shape(float x, float y, uint32_t color) : x(x), y(y), color(color) {}
+        virtual ~Shape() {}
+        /* rasterizes the part of the shape inside tile t */
+        virtual void draw(Framebuffer& fb, const Tile& t) const = 0;
+        /* bounding box used for binning */
+        virtual Tile bounds() const = 0;
+    protected:
+        Tile box(float rx, float ry) const {
+            return Tile{ int(floor(x - rx)), int(floor(y - ry)), int(ceil(x + rx)), int(ceil(y + ry)) };
+        }
+
+        float x, y;     // center
+        uint32_t color;
+};
+
+class Circle : public Shape {
+    public:
+        Circle(float x, float y, float r, uint32_t c) : Shape(x, y, c), r(r) {}
+        void draw(Framebuffer& fb, const Tile& t) const { fillEllipse(fb, t, x, y, r, r, color); }
+        Tile bounds() const { return box(r, r); }
+    private:
+        float r;
+};
+class Ellipse : public Shape {
+    public:
+        Ellipse(float x, float y, float rx, float ry, uint32_t c) : Shape(x, y, c), rx(rx), ry(ry) {}
+        void draw(Framebuffer& fb, const Tile& t) const { fillEllipse(fb, t, x, y, rx, ry, color); }
+        Tile bounds() const { return box(rx, ry); }
+    private:
+        float rx, ry;
+};
+class Rectangle : public Shape {
+    public:
+        Rectangle(float x, float y, float w, float h, uint32_t c) : Shape(x, y, c), hw(w / 2), hh(h / 2) {}
+        void draw(Framebuffer& fb, const Tile& t) const { fillRect(fb, t, x - hw, y - hh, x + hw, y + hh, color); }
+        Tile bounds() const {
+            return Tile{ int(lround(x - hw)), int(lround(y - hh)), int(lround(x + hw)), int(lround(y + hh)) };
+        }
+    private:
+        float hw, hh;
+};
+class Square : public Rectangle {
+    public:
+        Square(float x, float y, float side, uint32_t c) : Rectangle(x, y, side, side, c) {}
+};
+
+//Abstract Factory
+class Factory {
+    public:
+        virtual ~Factory() {}
+        virtual Shape* createCurvedInstance(float x, float y, float size, uint32_t color) = 0;
+        virtual Shape* createStraightInstance(float x, float y, float size, uint32_t color) = 0;
+};
+
+class SimpleShapeFactory : public Factory {
+    public:
+        Shape* createCurvedInstance(float x, float y, float s, uint32_t c) { return new Circle(x, y, s, c); }
+        Shape* createStraightInstance(float x, float y, float s, uint32_t c) { return new Square(x, y, s, c); }
+};
+class RobustShapeFactory : public Factory {
+    public:
+        Shape* createCurvedInstance(float x, float y, float s, uint32_t c) { return new Ellipse(x, y, s, s / 2, c); }
+        Shape* createStraightInstance(float x, float y, float s, uint32_t c) { return new Rectangle(x, y, s, s / 2, c); }
+};
+
+/* Runs job(i) for i in [0,n) on per-worker deques; idle workers steal.
+   The threads are started once and sleep between parallelFor calls, the
+   caller itself is worker 0. */
+class WorkStealingPool {
+    public:
+        explicit WorkStealingPool(unsigned threads) : queues(threads) {
+            for (unsigned w = 1; w < threads; w++)
+                threads_.emplace_back([this, w] { serve(w); });
+        }
+        ~WorkStealingPool() {
+            {
+                lock_guard<mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (thread& t : threads_)
+                t.join();
+        }
+
+        void parallelFor(int n, const function<void(int)>& job) {
+            unsigned workers = queues.size();
+            for (int i = 0; i < n; i++)
+                queues[i % workers].items.push_back(i);
+            {
+                lock_guard<mutex> lock(m);
+                current = &job;
+                finished = 0;
+                round++;
+            }
+            wake.notify_all();
+            work(0, job);
+            unique_lock<mutex> lock(m);
+            done.wait(lock, [this] { return finished == threads_.size(); });
+            current = nullptr;
+        }
+    private:
+        struct Queue {
+            mutex m;
+            deque<int> items;
+        };
+        /* worker w sleeps until the next round, joins it, and reports back */
+        void serve(unsigned w) {
+            unsigned long seen = 0;
+            unique_lock<mutex> lock(m);
+            for (;;) {
+                wake.wait(lock, [&] { return stopping || round != seen; });
+                if (stopping)
+                    return;
+                seen = round;
+                const function<void(int)>& job = *current;
+                lock.unlock();
+                work(w, job);
+                lock.lock();
+                if (++finished == threads_.size())
+                    done.notify_one();
+            }
+        }
+        /* no job adds jobs, so once every queue is empty the loop is done */
+        void work(unsigned self, const function<void(int)>& job) {
+            unsigned workers = queues.size();
+            unsigned victim = self;
+            for (;;) {
+                int item;
+                if (pop(queues[self], item, true)) {
+                    job(item);
+                    continue;
+                }
+                bool stolen = false;
+                for (unsigned k = 1; k < workers && !stolen; k++) {
+                    victim = (victim * 1103515245u + 12345u + k) % workers;
+                    stolen = victim != self && pop(queues[victim], item, false);
+                }
+                for (unsigned k = 1; k < workers && !stolen; k++)
+                    stolen = pop(queues[(self + k) % workers], item, false);
+                if (!stolen)
+                    return;
+                job(item);
+            }
+        }
+        /* owner takes from the back, thieves from the front */
+        static bool pop(Queue& q, int& item, bool owner) {
+            lock_guard<mutex> lock(q.m);
+            if (q.items.empty())
+                return false;
+            if (owner) { item = q.items.back(); q.items.pop_back(); }
+            else       { item = q.items.front(); q.items.pop_front(); }
+            return true;
+        }
+
+        vector<Queue> queues;
+        vector<thread> threads_;
+        mutex m;
+        condition_variable wake, done;
+        const function<void(int)>* current = nullptr;
+        unsigned long round = 0;
+        size_t finished = 0;
+        bool stopping = false;
+};
+
+/* Bins shapes into tiles and renders the tiles in parallel */
+class TiledRenderer {
+    public:
+        static const int tileSize = 64;
+
+        TiledRenderer(Framebuffer& fb) : fb(fb),
+            tilesX((fb.width + tileSize - 1) / tileSize),
+            tilesY((fb.height + tileSize - 1) / tileSize) {}
+
+        void render(const vector<Shape*>& shapes, WorkStealingPool& pool) {
+            vector<vector<uint32_t>> bins(tilesX * tilesY);
+            for (uint32_t i = 0; i < shapes.size(); i++) {
+                Tile b = shapes[i]->bounds();
+                int tx0 = max(0, b.x0 / tileSize), tx1 = min(tilesX - 1, (b.x1 - 1) / tileSize);
+                int ty0 = max(0, b.y0 / tileSize), ty1 = min(tilesY - 1, (b.y1 - 1) / tileSize);
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                        bins[ty * tilesX + tx].push_back(i);
+            }
+            pool.parallelFor(tilesX * tilesY, [&](int tile) {
+                int tx = tile % tilesX, ty = tile / tilesX;
+                Tile t = { tx * tileSize, ty * tileSize,
+                           min(fb.width, (tx + 1) * tileSize), min(fb.height, (ty + 1) * tileSize) };
+                for (uint32_t i : bins[tile])
+                    shapes[i]->draw(fb, t);
+            });
+        }
+    private:
+        Framebuffer& fb;
+        int tilesX, tilesY;
+};
+
+/* Random scene of n small shapes from both factories */
+static vector<Shape*> makeScene(size_t n, int width, int height) {
+    SimpleShapeFactory simple;
+    RobustShapeFactory robust;
+    vector<Shape*> shapes;
+    shapes.reserve(n);
+    uint32_t state = 2463534242u;
+    auto next = [&state] { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; };
+    for (size_t i = 0; i < n; i++) {
+        Factory& f = (i & 2) ? (Factory&)robust : (Factory&)simple;
+        float x = next() % width, y = next() % height, s = 2 + next() % 12;
+        uint32_t c = next() | 0xff000000u;
+        shapes.push_back((i & 1) ? f.createStraightInstance(x, y, s, c)
+                                 : f.createCurvedInstance(x, y, s, c));
+    }
+    return shapes;
+}
+
+int main(int argc, char* argv[]) {
+    Factory* Sfactory = new SimpleShapeFactory;
+    Factory* Rfactory = new RobustShapeFactory;
+    vector<Shape*> shapes;
+
+    shapes.push_back(Sfactory->createCurvedInstance(60, 60, 40, 0xff3030ffu));      //new Circle;
+    shapes.push_back(Sfactory->createStraightInstance(160, 60, 70, 0xff30ff30u));   //new Square;
+    shapes.push_back(Sfactory->createCurvedInstance(260, 60, 30, 0xffff3030u));     //new Circle;
+    shapes.push_back(Rfactory->createCurvedInstance(60, 160, 50, 0xff30ffffu));     //new Ellipse;
+    shapes.push_back(Rfactory->createStraightInstance(160, 160, 80, 0xffff30ffu));  //new Rectangle;
+    shapes.push_back(Rfactory->createCurvedInstance(260, 160, 40, 0xffffff30u));    //new Ellipse;
+
+    unsigned hw = max(1u, thread::hardware_concurrency());
+    WorkStealingPool demoPool(hw);
+    Framebuffer demo(320, 220);
+    TiledRenderer(demo).render(shapes, demoPool);
+    demo.writePPM("shapes.ppm");
+    cout << shapes.size() << " shapes drawn to shapes.ppm" << endl;
+    for (Shape* s : shapes) delete s;
+
+    vector<size_t> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back(strtoull(argv[i], nullptr, 10));
+    if (counts.empty())
+        counts = {100000, 1000000};
+
+    /* pools are started once, so thread creation is not part of the timings */
+    vector<unique_ptr<WorkStealingPool>> pools;
+    for (unsigned threads = 1; threads <= hw; threads *= 2)
+        pools.emplace_back(new WorkStealingPool(threads));
+
+    Framebuffer fb(1920, 1080);
+    for (size_t n : counts) {
+        vector<Shape*> scene = makeScene(n, fb.width, fb.height);
+        double base = 0;
+        for (unsigned p = 0, threads = 1; p < pools.size(); p++, threads *= 2) {
+            WorkStealingPool& pool = *pools[p];
+            fb.clear();
+            auto start = chrono::steady_clock::now();
+            TiledRenderer(fb).render(scene, pool);
+            double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (threads == 1) base = sec;
+            cout << n << " shapes, " << threads << " threads: " << n / sec / 1e6
+                 << " M shapes/s, speedup " << base / sec << "x" << endl;
+        }
+        for (Shape* s : scene) delete s;
+    }
+    delete Sfactory;
+    delete Rfactory;
+    return EXIT_SUCCESS;
+}
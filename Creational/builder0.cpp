@@ -20,18 +20,38 @@ How to solve such problems:
     a separate Builder object.
     --A class delegates object creation to a Builder object instead of
     creating the objects directly.
+
+The Builder below is constexpr: fixed configuration Products can be built and
+validated by the compiler, and end up as read-only data with no code run at
+startup. An inconsistent combination in a constant expression reaches a throw
+and is therefore a compile error; the same check throws at run-time.
+
+For bulk loads Product::BatchBuilder takes whole columns of i, f and c,
+applies defaults and validation in one pass per column and emits either a
+std::vector<Product> or a struct-of-arrays ProductColumns.
 */
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <span>
+#include <chrono>
+#include <limits>
 
 ////// Product declarations and inline impl. (Product.h) //////
 class Product{
 	public:
 		// use this class to construct Product
 		class Builder;
+		// use this class to construct many Products from columns
+		class BatchBuilder;
         // Product specific functionality
-		void print();
+		void print() const;
 		void doSomething();
 		void doSomethingElse();
+		constexpr int   getI() const { return i; }
+		constexpr float getF() const { return f; }
+		constexpr char  getC() const { return c; }
 	private:
 		// ariables in need of initialization to make valid object
 		const int i;
@@ -39,7 +59,15 @@ class Product{
 		const char c;
 
 		//Simple constructor - rest is handled by Builder
-		Product(const int i, const float f, const char c) : i(i), f(f), c(c) {}
+		constexpr Product(const int i, const float f, const char c) : i(i), f(f), c(c) {}
+};
+
+// Products stored column-wise (struct-of-arrays)
+struct ProductColumns{
+	std::vector<int>   i;
+	std::vector<float> f;
+	std::vector<char>  c;
+	size_t size() const { return i.size(); }
 };
 
 class Product::Builder{
@@ -56,32 +84,110 @@ class Product::Builder{
 
 		// create Builder with default values assigned
 		// (in C++11 they can be simply assigned above on declaration instead)
-		Builder() : i( defaultI ), f( defaultF ), c( defaultC ){ }
+		constexpr Builder() : i( defaultI ), f( defaultF ), c( defaultC ){ }
 
 		// sets custom values for Product creation
 		// returns Builder for shorthand inline usage (same way as cout <<)
-		Builder& setI( const int i )  { this->i = i; return *this; }
-		Builder& setF( const float f ){ this->f = f; return *this; }
-		Builder& setC( const char c ) { this->c = c; return *this; }
+		constexpr Builder& setI( const int i )  { this->i = i; return *this; }
+		constexpr Builder& setF( const float f ){ this->f = f; return *this; }
+		constexpr Builder& setC( const char c ) { this->c = c; return *this; }
 
 		// prepare specific frequently desired Product
 		// returns Builder for shorthand inline usage (same way as cout <<)
-		Builder& setProductP(){
+		constexpr Builder& setProductP(){
 			this->i = 1;
 			this->f = -1.0f/10.0f;
 			this->c = '@';
 			return *this;
 		}
+		// consistency rules for each variable
+		static constexpr bool validI( const int i )  { return i >= 0; }
+		static constexpr bool validF( const float f ){ return f <= std::numeric_limits<float>::max() && f >= -std::numeric_limits<float>::max(); }
+		static constexpr bool validC( const char c ) { return c >= ' ' && c <= '~'; }
+
 		// produce desired Product
-		Product build(){
-			//optionaly check var consistency and if Product
-			//is buildable from given information
+		constexpr Product build() const {
+			// check var consistency and if Product is buildable from given
+			// information; in a constant expression a throw is a compile error
+			if( !validI(this->i) )
+				throw std::invalid_argument("Product: i must not be negative");
+			if( !validF(this->f) )
+				throw std::invalid_argument("Product: f must be finite");
+			if( !validC(this->c) )
+				throw std::invalid_argument("Product: c must be printable");
 			return Product( this->i, this->f, this->c );
 		}
 };
 
+class Product::BatchBuilder{
+	private:
+		// input columns, not owned; an empty column means "use the default"
+		std::span<const int>   i;
+		std::span<const float> f;
+		std::span<const char>  c;
+		size_t rows;
+
+		// sets the row count from the first non-empty column, checks the others
+		void setRows( size_t n ){
+			if( rows != 0 && n != 0 && n != rows )
+				throw std::invalid_argument("Product: columns differ in length");
+			if( n != 0 ) rows = n;
+		}
+		// one branch-free pass counting bad rows; only on failure find the row
+		template <class T, class Valid>
+		static void validate( std::span<const T> col, Valid valid, const char* what ){
+			size_t bad = 0;
+			for( size_t r = 0; r < col.size(); r++ )
+				bad += !valid( col[r] );
+			if( bad == 0 ) return;
+			size_t r = 0;
+			while( valid( col[r] ) ) r++;
+			throw std::invalid_argument(std::string("Product: ") + what + " (row " + std::to_string(r) + ")");
+		}
+		// copies a column, or fills it with the default when none was given
+		template <class T>
+		void fillColumn( std::vector<T>& out, std::span<const T> col, T def ) const {
+			if( col.empty() ) out.assign( rows, def );
+			else out.assign( col.begin(), col.end() );
+		}
+	public:
+		BatchBuilder() : rows(0) {}
+
+		// sets input columns; returns BatchBuilder for shorthand inline usage
+		BatchBuilder& setI( std::span<const int> col )  { setRows(col.size()); i = col; return *this; }
+		BatchBuilder& setF( std::span<const float> col ){ setRows(col.size()); f = col; return *this; }
+		BatchBuilder& setC( std::span<const char> col ) { setRows(col.size()); c = col; return *this; }
+
+		// validate every given column (defaults are valid by construction)
+		void check() const {
+			validate( i, Builder::validI, "i must not be negative" );
+			validate( f, Builder::validF, "f must be finite" );
+			validate( c, Builder::validC, "c must be printable" );
+		}
+		// produce all Products as struct-of-arrays
+		ProductColumns buildColumns() const {
+			check();
+			ProductColumns out;
+			fillColumn( out.i, i, Builder::defaultI );
+			fillColumn( out.f, f, Builder::defaultF );
+			fillColumn( out.c, c, Builder::defaultC );
+			return out;
+		}
+		// produce all Products as array-of-structs
+		std::vector<Product> build() const {
+			check();
+			std::vector<Product> out;
+			out.reserve( rows );
+			for( size_t r = 0; r < rows; r++ )
+				out.push_back( Product( i.empty() ? Builder::defaultI : i[r],
+				                        f.empty() ? Builder::defaultF : f[r],
+				                        c.empty() ? Builder::defaultC : c[r] ) );
+			return out;
+		}
+};
+
 ///// Product implementation (possibly Product.cpp) /////
-void Product::print(){
+void Product::print() const {
 	using namespace std;
 
 	cout << "Product internals dump:" << endl;
@@ -93,8 +199,41 @@ void Product::doSomething() {}
 void Product::doSomethingElse() {}
 
 
+///// Fixed configuration Products, built and checked by the compiler /////
+// constexpr guarantees constant initialization: these objects are emitted
+// fully formed into read-only data (or folded away entirely), so no
+// constructor, builder call or check runs at startup.
+constexpr Product defaultProduct = Product::Builder().build();
+constexpr Product productP = Product::Builder().setProductP().build();
+constexpr Product productX = Product::Builder().setI(100).setF(100.5f).setC('x').build();
+
+static_assert( productP.getI() == 1 && productP.getC() == '@', "Product P" );
+static_assert( productX.getF() == 100.5f, "Product X" );
+static_assert( Product::Builder::validF( 3e38f ) && !Product::Builder::validF( std::numeric_limits<float>::infinity() ), "finite f only" );
+
+// Invalid combinations do not compile, e.g.
+// constexpr Product bad = Product::Builder().setI(-1).build();
+//   error: expression '<throw-expression>' is not a constant expression
+
+// best of three runs of build(), in rows per second
+template <class Build>
+double rowsPerSecond( size_t rows, Build build ){
+	double best = 0;
+	for( int run = 0; run < 3; run++ ){
+		auto start = std::chrono::steady_clock::now();
+		build();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if( rows / elapsed.count() > best ) best = rows / elapsed.count();
+	}
+	return best;
+}
+
 //////////////////// Usage of Builder (replaces Director from diagram)
 int main(){
+	// constant Products are ready before main() starts
+	defaultProduct.print();
+	productP.print();
+
 	// simple usage
 	Product p1 = Product::Builder().setI(100).setF(100.5f).setC('x').build();
 	p1.print(); // test p1
@@ -107,4 +246,49 @@ int main(){
 	Product p3 = b.build();
 	p2.print(); // test p2
 	p3.print(); // test p3
+
+	// runtime builds are still checked
+	try {
+		Product::Builder().setC('\n').build();
+	} catch( const std::invalid_argument& e ) {
+		std::cout << "rejected: " << e.what() << std::endl;
+	}
+
+	// batch usage: rows of input as columns, f left at its default
+	const size_t rows = 5000000;
+	std::vector<int> is( rows );
+	std::vector<char> cs( rows );
+	for( size_t r = 0; r < rows; r++ ){
+		is[r] = r % 1000;
+		cs[r] = 'a' + r % 26;
+	}
+	std::vector<Product> perRow, batch;
+	ProductColumns columns;
+	double perRowRate = rowsPerSecond( rows, [&]{
+		perRow.clear();
+		perRow.shrink_to_fit();
+		perRow.reserve( rows );
+		for( size_t r = 0; r < rows; r++ )
+			perRow.push_back( Product::Builder().setI(is[r]).setC(cs[r]).build() );
+	});
+	double batchRate = rowsPerSecond( rows, [&]{
+		batch = Product::BatchBuilder().setI(is).setC(cs).build();
+	});
+	double columnsRate = rowsPerSecond( rows, [&]{
+		columns = Product::BatchBuilder().setI(is).setC(cs).buildColumns();
+	});
+
+	std::cout << rows << " rows, M rows/s: per-row Builder " << perRowRate / 1e6
+	          << ", BatchBuilder::build " << batchRate / 1e6
+	          << ", BatchBuilder::buildColumns " << columnsRate / 1e6 << std::endl;
+	std::cout << "last: " << perRow.back().getI() << perRow.back().getC()
+	          << " / " << batch.back().getI() << batch.back().getC()
+	          << " / " << columns.i.back() << columns.c.back() << std::endl;
+
+	is[42] = -7;
+	try {
+		Product::BatchBuilder().setI(is).buildColumns();
+	} catch( const std::invalid_argument& e ) {
+		std::cout << "rejected: " << e.what() << std::endl;
+	}
 }
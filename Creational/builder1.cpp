@@ -1,8 +1,29 @@
 /*
  * Copyright (C) 2011 Radek Pazdera
+ *
+ * Cars hold their parts by value, and builders write each part into storage
+ * provided by the caller. A single car is then one object (no allocation at
+ * all when it lives on the stack), and a whole fleet can be built into one
+ * CarArena allocation.
+ *
+ * Builders are stateless and their methods const, so they may be called from
+ * several threads at once. ParallelDirector uses that to build a large mixed
+ * fleet on a work-stealing pool: the fleet is cut into chunks, each chunk
+ * owns a disjoint slice of the one arena block, and idle workers steal
+ * chunks from busy ones. The result is still a single contiguous fleet.
  */
 #include <iostream>
-#include <string>
+#include <span>
+#include <vector>
+#include <new>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
 
 /* Car parts */
 class Wheel
@@ -18,108 +39,280 @@ class Engine
 class Body
 {
     public:
-        std::string shape;
+        const char* shape;  // static name, e.g. "SUV"
 };
 /* Final product -- a car */
 class Car
 {
     public:
-        Wheel*  wheels[4];
-        Engine* engine;
-        Body*   body;
-        void specifications()
+        Wheel  wheels[4];
+        Engine engine;
+        Body   body;
+        void specifications() const
         {
-            std::cout << "body:" << body->shape << std::endl;
-            std::cout << "engine horsepower:" << engine->horsepower << std::endl;
-            std::cout << "tire size:" << wheels[0]->size << "'" << std::endl;
+            std::cout << "body:" << body.shape << std::endl;
+            std::cout << "engine horsepower:" << engine.horsepower << std::endl;
+            std::cout << "tire size:" << wheels[0].size << "'" << std::endl;
         }
 };
 
-/* Builder is responsible for constructing the smaller parts */
+/* Builder is responsible for constructing the smaller parts
+   in storage provided by the caller; safe to call concurrently */
 class Builder
 {
     public:
-        virtual Wheel*  getWheel()  = 0;
-        virtual Engine* getEngine() = 0;
-        virtual Body*   getBody()   = 0;
+        virtual ~Builder() {}
+        virtual void buildWheel(Wheel& wheel) const    = 0;
+        virtual void buildEngine(Engine& engine) const = 0;
+        virtual void buildBody(Body& body) const       = 0;
+};
+
+/* One contiguous block of cars; released all at once */
+class CarArena
+{
+    public:
+        explicit CarArena(std::size_t capacity)
+            : cars(static_cast<Car*>(::operator new(capacity * sizeof(Car)))),
+              capacity(capacity), used(0) {}
+        ~CarArena() { ::operator delete(cars); }
+        CarArena(const CarArena&) = delete;
+        CarArena& operator=(const CarArena&) = delete;
+
+        /* room for n more cars, or nullptr when the arena is full */
+        Car* allocate(std::size_t n)
+        {
+            if (capacity - used < n) { return nullptr; }
+            Car* first = cars + used;
+            used += n;
+            return first;
+        }
+        std::size_t bytes() const { return capacity * sizeof(Car); }
+    private:
+        Car* cars;
+        std::size_t capacity;
+        std::size_t used;
 };
 
 /*  Director is responsible for the whole process
     Uses Interface Builder to build parts of car */
 class Director
 {
-    Builder* builder;
+    const Builder* builder;
     public:
         //set JeepBuilder or NissanBuilder
-        void setBuilder(Builder* newBuilder) { builder = newBuilder; }
-        Car* getCar()
+        void setBuilder(const Builder* newBuilder) { builder = newBuilder; }
+        /* builds a car in place */
+        void buildCar(Car& car)
         {
-            Car* car = new Car();
-            car->body      = builder->getBody();
-            car->engine    = builder->getEngine();
-            car->wheels[0] = builder->getWheel();
-            car->wheels[1] = builder->getWheel();
-            car->wheels[2] = builder->getWheel();
-            car->wheels[3] = builder->getWheel();
-
+            builder->buildBody(car.body);
+            builder->buildEngine(car.engine);
+            builder->buildWheel(car.wheels[0]);
+            builder->buildWheel(car.wheels[1]);
+            builder->buildWheel(car.wheels[2]);
+            builder->buildWheel(car.wheels[3]);
+        }
+        Car getCar()
+        {
+            Car car;
+            buildCar(car);
             return car;
         }
+        /* builds n cars into one arena allocation */
+        std::span<Car> getFleet(CarArena& arena, std::size_t n)
+        {
+            Car* cars = arena.allocate(n);
+            if (cars == nullptr) { return std::span<Car>(); }
+            for (std::size_t i = 0; i < n; i++)
+                buildCar(*new (cars + i) Car);
+            return std::span<Car>(cars, n);
+        }
 };
 
 /* Concrete Builder for Jeep SUV cars */
 class JeepBuilder : public Builder
 {
     public:
-        Wheel* getWheel()
+        void buildWheel(Wheel& wheel) const    { wheel.size = 22; }
+        void buildEngine(Engine& engine) const { engine.horsepower = 400; }
+        void buildBody(Body& body) const       { body.shape = "SUV"; }
+};
+
+/* Concrete builder for Nissan family cars */
+class NissanBuilder : public Builder
+{
+    public:
+        void buildWheel(Wheel& wheel) const    { wheel.size = 16; }
+        void buildEngine(Engine& engine) const { engine.horsepower = 85; }
+        void buildBody(Body& body) const       { body.shape = "hatchback"; }
+};
+
+/* Runs job(i) for i in [0,n) on per-worker deques; idle workers steal.
+   Worker threads live as long as the pool, the caller is worker 0. */
+class WorkStealingPool
+{
+    public:
+        explicit WorkStealingPool(unsigned workers) : queues(std::max(1u, workers))
         {
-            Wheel* wheel = new Wheel();
-            wheel->size = 22;
-            return wheel;
+            for (std::size_t w = 1; w < queues.size(); w++)
+                threads.emplace_back([this, w] { serve(w); });
         }
-
-        Engine* getEngine()
+        ~WorkStealingPool()
         {
-            Engine* engine = new Engine();
-            engine->horsepower = 400;
-            return engine;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& t : threads)
+                t.join();
         }
 
-        Body* getBody()
+        void parallelFor(std::size_t n, const std::function<void(std::size_t)>& job)
+        {
+            std::size_t workers = queues.size();
+            for (std::size_t i = 0; i < n; i++)
+                queues[i % workers].items.push_back(i);
+            {
+                std::lock_guard<std::mutex> lock(m);
+                current = &job;
+                finished = 0;
+                round++;
+            }
+            wake.notify_all();
+            work(0, job);
+            std::unique_lock<std::mutex> lock(m);
+            done.wait(lock, [this] { return finished == threads.size(); });
+            current = nullptr;
+        }
+    private:
+        struct Queue
+        {
+            std::mutex m;
+            std::deque<std::size_t> items;
+        };
+        /* sleeps until parallelFor starts a round, then works it */
+        void serve(std::size_t self)
         {
-            Body* body = new Body();
-            body->shape = "SUV";
+            unsigned long seen = 0;
+            std::unique_lock<std::mutex> lock(m);
+            for (;;)
+            {
+                wake.wait(lock, [&] { return stopping || round != seen; });
+                if (stopping) { return; }
+                seen = round;
+                const std::function<void(std::size_t)>& job = *current;
+                lock.unlock();
+                work(self, job);
+                lock.lock();
+                if (++finished == threads.size()) { done.notify_one(); }
+            }
         }
+        /* no job adds jobs, so once every queue is empty the loop is done */
+        void work(std::size_t self, const std::function<void(std::size_t)>& job)
+        {
+            std::size_t workers = queues.size();
+            unsigned seed = self * 2654435761u + 1;
+            std::size_t item;
+            for (;;)
+            {
+                if (pop(queues[self], item, true)) { job(item); continue; }
+                bool stolen = false;
+                std::size_t start = (seed = seed * 1103515245u + 12345u) % workers;
+                for (std::size_t k = 0; k < workers && !stolen; k++)
+                {
+                    std::size_t victim = (start + k) % workers;
+                    stolen = victim != self && pop(queues[victim], item, false);
+                }
+                if (!stolen) { return; }
+                job(item);
+            }
+        }
+        /* owner takes from the back, thieves from the front */
+        static bool pop(Queue& q, std::size_t& item, bool owner)
+        {
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.items.empty()) { return false; }
+            if (owner) { item = q.items.back(); q.items.pop_back(); }
+            else       { item = q.items.front(); q.items.pop_front(); }
+            return true;
+        }
+
+        std::vector<Queue> queues;
+        std::vector<std::thread> threads;
+        std::mutex m;
+        std::condition_variable wake, done;
+        const std::function<void(std::size_t)>* current = nullptr;
+        unsigned long round = 0;
+        std::size_t finished = 0;
+        bool stopping = false;
 };
 
-/* Concrete builder for Nissan family cars */
-class NissanBuilder : public Builder
+/* n cars from one builder */
+struct FleetOrder
+{
+    const Builder* builder;
+    std::size_t count;
+};
+typedef std::vector<FleetOrder> FleetSpec;
+
+/* cars needed for the whole spec, i.e. the arena capacity to reserve */
+std::size_t fleetSize(const FleetSpec& spec)
+{
+    std::size_t total = 0;
+    for (const FleetOrder& order : spec)
+        total += order.count;
+    return total;
+}
+
+/* Director that builds a whole fleet spec across a thread pool */
+class ParallelDirector
 {
     public:
-        Wheel* getWheel()
-        {
-            Wheel* wheel = new Wheel();
-            wheel->size = 16;
-            return wheel;
-        }
+        static const std::size_t chunkSize = 4096;
 
-        Engine* getEngine()
-        {
-            Engine* engine = new Engine();
-            engine->horsepower = 85;
-            return engine;
-        }
+        explicit ParallelDirector(unsigned threads) : pool(threads) {}
 
-        Body* getBody()
+        /* cars of each order are consecutive, in spec order */
+        std::span<Car> getFleet(CarArena& arena, const FleetSpec& spec)
         {
-            Body* body = new Body();
-            body->shape = "hatchback";
+            struct Chunk { const Builder* builder; std::size_t first, count; };
+            std::vector<Chunk> chunks;
+            std::size_t first = 0;
+            for (const FleetOrder& order : spec)
+            {
+                for (std::size_t done = 0; done < order.count; done += chunkSize)
+                    chunks.push_back({ order.builder, first + done,
+                                       std::min(chunkSize, order.count - done) });
+                first += order.count;
+            }
+            std::size_t total = fleetSize(spec);
+            Car* cars = arena.allocate(total);
+            if (cars == nullptr) { return std::span<Car>(); }
+
+            pool.parallelFor(chunks.size(), [&](std::size_t k) {
+                const Chunk& chunk = chunks[k];
+                Director director;
+                director.setBuilder(chunk.builder);
+                for (std::size_t i = chunk.first; i < chunk.first + chunk.count; i++)
+                    director.buildCar(*new (cars + i) Car);
+            });
+            return std::span<Car>(cars, total);
         }
+    private:
+        WorkStealingPool pool;
 };
 
+/* Previous layout: one heap object per part, kept for comparison only */
+struct HeapCar
+{
+    Wheel*  wheels[4];
+    Engine* engine;
+    Body*   body;
+};
 
 int main()
 {
-    Car* car; // Final product
+    Car car; // Final product
 
     /* A director who controls the process */
     Director director;
@@ -132,7 +325,7 @@ int main()
     std::cout << "Jeep" << std::endl;
     director.setBuilder(&jeepBuilder); // using JeepBuilder instance
     car = director.getCar();
-    car->specifications();
+    car.specifications();
 
     std::cout << std::endl;
 
@@ -140,7 +333,82 @@ int main()
     std::cout << "Nissan" << std::endl;
     director.setBuilder(&nissanBuilder); // using NissanBuilder instance
     car = director.getCar();
-    car->specifications();
+    car.specifications();
+
+    std::cout << std::endl;
+
+    /* Cars per second and memory per car */
+    const std::size_t n = 2000000;
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double> seconds;
+
+    const Builder& builder = nissanBuilder;
+    auto t0 = clock::now();
+    std::vector<HeapCar*> heapCars;
+    heapCars.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+    {
+        HeapCar* c = new HeapCar;
+        c->body = new Body;
+        builder.buildBody(*c->body);
+        c->engine = new Engine;
+        builder.buildEngine(*c->engine);
+        for (Wheel*& w : c->wheels)
+        {
+            w = new Wheel;
+            builder.buildWheel(*w);
+        }
+        heapCars.push_back(c);
+    }
+    auto t1 = clock::now();
+    std::vector<Car> cars;
+    cars.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+        cars.push_back(director.getCar());
+    auto t2 = clock::now();
+    CarArena arena(n);
+    std::span<Car> fleet = director.getFleet(arena, n);
+    auto t3 = clock::now();
 
+    std::size_t heapBytes = sizeof(HeapCar) + 4 * sizeof(Wheel) + sizeof(Engine) + sizeof(Body);
+    std::cout << n << " cars" << std::endl;
+    std::cout << "part per allocation: " << n / seconds(t1 - t0).count() / 1e6 << " M cars/s, "
+              << heapBytes << " bytes/car + 6 allocations" << std::endl;
+    std::cout << "car by value:        " << n / seconds(t2 - t1).count() / 1e6 << " M cars/s, "
+              << sizeof(Car) << " bytes/car" << std::endl;
+    std::cout << "fleet in arena:      " << n / seconds(t3 - t2).count() / 1e6 << " M cars/s, "
+              << arena.bytes() / fleet.size() << " bytes/car, 1 allocation" << std::endl;
+
+    for (HeapCar* c : heapCars)
+    {
+        for (Wheel* w : c->wheels) { delete w; }
+        delete c->engine;
+        delete c->body;
+        delete c;
+    }
+    std::cout << std::endl;
+
+    /* Mixed fleet built in parallel, scaling from 1 to N threads */
+    FleetSpec spec = { { &jeepBuilder, 2500000 }, { &nissanBuilder, 1500000 } };
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    double base = 0;
+    for (unsigned threads = 1; ; threads = std::min(hw, threads * 2))
+    {
+        ParallelDirector parallel(threads);     // starts the pool, not timed
+        CarArena fleetArena(fleetSize(spec));
+        auto start = clock::now();
+        std::span<Car> mixed = parallel.getFleet(fleetArena, spec);
+        double sec = seconds(clock::now() - start).count();
+        if (mixed.empty())
+        {
+            std::cout << "arena too small for the fleet" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (threads == 1) { base = sec; }
+        std::cout << mixed.size() << " cars, " << threads << " threads: "
+                  << mixed.size() / sec / 1e6 << " M cars/s, speedup " << base / sec
+                  << "x (last: " << mixed.back().body.shape << ")" << std::endl;
+        if (threads == hw) { break; }
+    }
     return 0;
 }
@@ -1,9 +1,41 @@
+/*
+Constructor and setter injection of ServiceA/ServiceB into a Client.
+
+Services that are expensive to build but rarely used can be injected as a
+LazyService proxy instead: the proxy implements the same interface, and the
+real service is constructed on the first call. Construction is thread-safe
+(std::call_once); afterwards each call costs one well-predicted branch on an
+atomic pointer load before forwarding.
+
+With Injector::timing switched on, every ServiceA/ServiceB binding is wrapped
+in a TimedService decorator that counts calls and records a latency histogram
+per service. There is one LatencyRecorder per binding name, shared by every
+decorator bound under that name, so building more clients does not use up
+recorders. Each thread writes to its own buffer, buffers are only merged
+when LatencyRecorder::dumpJson() reads them. With timing off the injector
+does not add the decorator, so there is no overhead at all.
+*/
 #include <iostream>
+#include <ostream>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/resource.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 //interface serviceA
 class ServiceA
 {
     public:
+        virtual ~ServiceA() {}
         virtual void executeService() = 0;
         //virtual ServiceA* interfaceInjection() = 0;
 };
@@ -11,6 +43,7 @@ class ServiceA
 class ServiceB
 {
     public:
+        virtual ~ServiceB() {}
         virtual void executeService() = 0;
         //virtual ServiceB* interfaceInjection() = 0;
 };
@@ -28,6 +61,27 @@ class ServiceB1 : public ServiceB
         void executeService() override { std::cout << "serviceB1 is working\n"; }
 };
 
+//Proxy for Service that constructs Impl on the first call
+template <class Service, class Impl>
+class LazyService : public Service
+{
+    public:
+        LazyService() : instance(nullptr) {}
+        ~LazyService() { delete instance.load(std::memory_order_relaxed); }
+        void executeService() override { real()->executeService(); }
+    private:
+        Service* real() {
+            Service* service = instance.load(std::memory_order_acquire);
+            if (service == nullptr) [[unlikely]] {
+                std::call_once(once, [this] { instance.store(new Impl, std::memory_order_release); });
+                service = instance.load(std::memory_order_acquire);
+            }
+            return service;
+        }
+        std::atomic<Service*> instance;
+        std::once_flag once;
+};
+
 
 class Client  {
     private:
@@ -61,25 +115,226 @@ class Client  {
        }
 };
 
+//Call counts and latency histograms of one service name. record() only
+//touches the calling thread's own buffer; dumpJson() merges all buffers.
+class LatencyRecorder
+{
+    public:
+        static const int maxRecorders = 64;  // distinct service names
+        static const int buckets = 40;      // bucket b: latency < 2^b ticks
+
+        //the recorder for name, created on first use and kept for the process
+        static LatencyRecorder& forName(const char* name) {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for (LatencyRecorder* recorder : r.recorders)
+                if (recorder->name == name)
+                    return *recorder;
+            if (r.recorders.size() >= maxRecorders) {
+                std::cout << "too many LatencyRecorder names\n";
+                std::abort();
+            }
+            r.recorders.push_back(new LatencyRecorder(name, r.recorders.size()));
+            return *r.recorders.back();
+        }
+        static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+        void record(std::uint64_t ticks) {
+            Buffer& b = buffer();
+            //single writer per buffer: plain load/store, no locked instruction
+            add(b.calls, 1);
+            add(b.ticks, ticks);
+            add(b.histogram[std::bit_width(ticks) < buckets ? std::bit_width(ticks) : buckets - 1], 1);
+        }
+        //writes every recorder as JSON, merging all thread buffers
+        static void dumpJson(std::ostream& out) {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            double nsPerTick = calibrate();
+            out << "{\"services\": [";
+            for (std::size_t i = 0; i < r.recorders.size(); i++) {
+                std::uint64_t calls = 0, ticks = 0, histogram[buckets] = {};
+                for (ThreadBuffers* t : r.threads) {
+                    const Buffer& b = t->buffers[i];
+                    calls += b.calls.load(std::memory_order_relaxed);
+                    ticks += b.ticks.load(std::memory_order_relaxed);
+                    for (int k = 0; k < buckets; k++)
+                        histogram[k] += b.histogram[k].load(std::memory_order_relaxed);
+                }
+                out << (i ? ", " : "") << "{\"name\": \"" << r.recorders[i]->name
+                    << "\", \"calls\": " << calls << ", \"mean_ns\": "
+                    << (calls ? ticks * nsPerTick / calls : 0) << ", \"histogram\": [";
+                bool first = true;
+                for (int k = 0; k < buckets; k++)
+                    if (histogram[k]) {
+                        out << (first ? "" : ", ") << "{\"le_ns\": " << (std::uint64_t(1) << k) * nsPerTick
+                            << ", \"count\": " << histogram[k] << "}";
+                        first = false;
+                    }
+                out << "]}";
+            }
+            out << "]}\n";
+        }
+    private:
+        LatencyRecorder(const char* name, std::size_t id) : name(name), id(id) {}
+
+        struct Buffer {
+            std::atomic<std::uint64_t> calls{0}, ticks{0};
+            std::atomic<std::uint64_t> histogram[buckets] = {};
+        };
+        struct ThreadBuffers {
+            Buffer buffers[maxRecorders];
+        };
+        struct Registry {
+            std::mutex mutex;
+            std::vector<LatencyRecorder*> recorders;  // one per name, never freed
+            std::vector<ThreadBuffers*> threads;    // kept after threads exit
+            std::uint64_t startTicks = now();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        };
+        static Registry& registry() {
+            static Registry r;
+            return r;
+        }
+        static void add(std::atomic<std::uint64_t>& a, std::uint64_t v) {
+            a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+        }
+        Buffer& buffer() {
+            thread_local ThreadBuffers* mine = nullptr;
+            if (mine == nullptr) [[unlikely]] {
+                mine = new ThreadBuffers;
+                std::lock_guard<std::mutex> lock(registry().mutex);
+                registry().threads.push_back(mine);
+            }
+            return mine->buffers[id];
+        }
+        //nanoseconds per tick, measured since the registry was created
+        static double calibrate() {
+            Registry& r = registry();
+            if (std::chrono::steady_clock::now() - r.start < std::chrono::milliseconds(10))
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            std::uint64_t ticks = now() - r.startTicks;
+            std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - r.start;
+            return ns.count() / ticks;
+        }
+
+        std::string name;
+        std::size_t id;
+};
+
+//Decorator that times every call of the wrapped service
+template <class Service>
+class TimedService : public Service
+{
+    public:
+        TimedService(Service* inner, const char* name)
+            : inner(inner), recorder(LatencyRecorder::forName(name)) {}
+        ~TimedService() { delete inner; }
+        void executeService() override {
+            std::uint64_t start = LatencyRecorder::now();
+            inner->executeService();
+            recorder.record(LatencyRecorder::now() - start);
+        }
+    private:
+        Service* inner;
+        LatencyRecorder& recorder;
+};
+
 //creates and injects to Client (depends on Client and ServicesA1-B1)
 class Injector {
     public:
+        //wrap every injected service in a TimedService
+        static bool timing;
+
         static Client* constructionInjectionClient(){
-            ServiceA1* sa1 = new ServiceA1;
-            ServiceB1* sb1 = new ServiceB1;
+            ServiceA* sa1 = bind<ServiceA>(new ServiceA1, "sa1");
+            ServiceB* sb1 = bind<ServiceB>(new ServiceB1, "sb1");
             std::cout << "service sa1 created...\n";
             std::cout << "service sb1 created...\n";
             return new Client(sa1, sb1);
         }
         static Client* setterInjectionClient(){
             Client* cl = new Client();
-            cl->setServiceA(new ServiceA1());
-            cl->setServiceB(new ServiceB1());
+            cl->setServiceA(bind<ServiceA>(new ServiceA1(), "sa1"));
+            cl->setServiceB(bind<ServiceB>(new ServiceB1(), "sb1"));
             std::cout << "service sa1 injected...\n";
             std::cout << "service sb1 injected...\n";
             return cl;
         }
+        //constructor injection of proxies; services are built on first use
+        static Client* lazyInjectionClient(){
+            ServiceA* sa1 = bind<ServiceA>(new LazyService<ServiceA, ServiceA1>, "lazy sa1");
+            ServiceB* sb1 = bind<ServiceB>(new LazyService<ServiceB, ServiceB1>, "lazy sb1");
+            std::cout << "lazy service sa1 created...\n";
+            std::cout << "lazy service sb1 created...\n";
+            return new Client(sa1, sb1);
+        }
+    private:
+        template <class Service>
+        static Service* bind(Service* service, const char* name){
+            if (!timing)
+                return service;
+            return new TimedService<Service>(service, name);
+        }
+};
+bool Injector::timing = false;
+
+//Cheapest possible service, to measure the decorator itself; not
+//thread-safe, so every thread needs its own
+class NullService : public ServiceA
+{
+    public:
+        void executeService() override { calls = calls + 1; }
+        volatile std::uint64_t calls = 0;   // volatile: the loop cannot be folded
+};
+
+//Stand-in for an expensive service: 1 MB of state filled in its constructor
+class HeavyService : public ServiceA
+{
+    public:
+        HeavyService() : state(1 << 18) {
+            for (std::size_t i = 0; i < state.size(); i++)
+                state[i] = i * 2654435761u;
+        }
+        void executeService() override { result = state[result % state.size()]; }
+        static unsigned result;
+    private:
+        std::vector<unsigned> state;
 };
+unsigned HeavyService::result = 0;
+
+//peak resident set size in MB
+static double peakRssMB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
+
+//Builds n services, calls every tenth one; prints time and peak RSS growth
+template <class Make>
+static void startup(const char* name, int n, Make make) {
+    double rss0 = peakRssMB();
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<ServiceA*> services;
+    for (int i = 0; i < n; i++)
+        services.push_back(make());
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i += 10)
+        services[i]->executeService();
+    auto t2 = std::chrono::steady_clock::now();
+
+    typedef std::chrono::duration<double, std::milli> ms;
+    std::cout << name << ": startup " << ms(t1 - t0).count() << " ms, first calls "
+              << ms(t2 - t1).count() << " ms, peak RSS +" << peakRssMB() - rss0 << " MB\n";
+    for (ServiceA* s : services)
+        delete s;
+}
 
 int main(){
     Client* clp;
@@ -89,6 +344,55 @@ int main(){
     std::cout << std::endl;
     Client* c = Injector::setterInjectionClient();
     c->callServices();
+    std::cout << std::endl;
+    Client* lc = Injector::lazyInjectionClient();
+    lc->callServices();
+    std::cout << std::endl;
+
+    //200 expensive services, 90% never called. Lazy runs first because the
+    //RSS figure is the growth of the process peak.
+    startup("lazy ", 200, [] { return new LazyService<ServiceA, HeavyService>; });
+    startup("eager", 200, [] { return new HeavyService; });
+    std::cout << std::endl;
+
+    //timing decorators injected by the container
+    Injector::timing = true;
+    Client* tc = Injector::constructionInjectionClient();
+    tc->callServices();
+    tc->callServices();
+    //every client shares the sa1/sb1 recorders, however many are built
+    std::streambuf* out = std::cout.rdbuf(nullptr);
+    for (int i = 0; i < 100; i++) {
+        Client* more = Injector::constructionInjectionClient();
+        more->callServices();
+        delete more;
+    }
+    std::cout.rdbuf(out);
+    Injector::timing = false;
+
+    const int n = 20000000;
+    ServiceA* plain = new NullService;
+    ServiceA* timed = new TimedService<ServiceA>(new NullService, "null");
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        plain->executeService();
+    auto t1 = std::chrono::steady_clock::now();
+    //its own service and decorator, but the same "null" recorder
+    std::thread other([] {
+        TimedService<ServiceA> mine(new NullService, "null");
+        for (int i = 0; i < 1000; i++)
+            mine.executeService();
+    });
+    for (int i = 0; i < n; i++)
+        timed->executeService();
+    auto t2 = std::chrono::steady_clock::now();
+    other.join();
+    typedef std::chrono::duration<double, std::nano> ns;
+    std::cout << "per call: plain " << ns(t1 - t0).count() / n << " ns, timed "
+              << ns(t2 - t1).count() / n << " ns" << std::endl;
+    LatencyRecorder::dumpJson(std::cout);
+    delete plain;
+    delete timed;
 
     return EXIT_SUCCESS;
 }
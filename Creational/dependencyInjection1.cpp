@@ -19,14 +19,25 @@ how to solve such problems:
     that a class requires.
     --A class accepts the objects it requires from an injector object instead
     of creating the objects directly.
+
+Shapes carry no state, so a single shared (flyweight) instance of each is
+enough. ShapeRegistry owns them and maps a ShapeKind straight to its
+instance, so IDrawing::draw() neither allocates nor compares strings; a
+shape name is turned into a ShapeKind once, outside the drawing loop.
 */
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
 using namespace std;
 
 class Shape
 {
     public:
+        virtual ~Shape() {}
         virtual void draw() = 0;
 };
 
@@ -55,6 +66,31 @@ class Drawing
         Shape *pShape;
 };
 
+enum class ShapeKind { Triangle, Circle, None };
+
+/* Shared shape instances and the ShapeKind -> instance dispatch table */
+class ShapeRegistry
+{
+public:
+  static Shape* get(ShapeKind k) { return table[static_cast<int>(k)]; }
+  /* one string compare per name, do it once and keep the ShapeKind */
+  static ShapeKind kind(string_view name)
+  {
+    if(name == "triangle")
+        return ShapeKind::Triangle;
+    if(name == "circle")
+        return ShapeKind::Circle;
+    return ShapeKind::None;
+  }
+private:
+  static Triangle triangle;
+  static Circle circle;
+  static Shape* const table[];
+};
+Triangle ShapeRegistry::triangle;
+Circle ShapeRegistry::circle;
+Shape* const ShapeRegistry::table[] = { &ShapeRegistry::triangle, &ShapeRegistry::circle, nullptr };
+
 /* 1. This class pulled the hard-coded shape info out of the Drawing class
    2. This class is an interface that can be modified depending on what to draw
    3. This class does Dependency Injection
@@ -63,19 +99,29 @@ class IDrawing
 {
 public:
   IDrawing() { d = new Drawing; }
-  void draw(string s)
+  ~IDrawing() { delete d; }
+  void draw(ShapeKind k)
   {
-    if(s == "triangle")
-        d->drawShape(new Triangle);
-    else if( s == "circle")
-        d->drawShape(new Circle);
+    if(Shape* shape = ShapeRegistry::get(k))
+        d->drawShape(shape);
     else
         cout << "Need shape\n";
   }
+  void draw(string_view s) { draw(ShapeRegistry::kind(s)); }
 private:
   Drawing *d;
 };
 
+/* Current resident set size in MB (Linux) */
+static double rssMB()
+{
+  ifstream statm("/proc/self/statm");
+  long pages = 0, resident = 0;
+  statm >> pages >> resident;
+  static const long pageSize = sysconf(_SC_PAGESIZE);  // 4K, 16K or 64K
+  return resident * double(pageSize) / (1 << 20);
+}
+
 int main(){
     Drawing dd;
     //in order to avoid dd.draw("circle")
@@ -87,5 +133,22 @@ int main(){
     drawObj.draw("triangle");
     drawObj.draw("");
 
+    /* Soak: 10^8 draws with output discarded, RSS must stay flat */
+    const long n = 100000000;
+    ofstream discard;
+    cout.flush();
+    streambuf* console = cout.rdbuf(discard.rdbuf());
+    ShapeKind kinds[] = { ShapeRegistry::kind("circle"), ShapeRegistry::kind("triangle") };
+    double rss0 = rssMB();
+    auto start = chrono::steady_clock::now();
+    for (long i = 1; i <= n; i++) {
+        drawObj.draw(kinds[i & 1]);
+        if (i % (n / 10) == 0)
+            clog << i << " draws, RSS " << rssMB() << " MB\n";
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout.rdbuf(console);
+    cout << n / elapsed.count() / 1e6 << " M draws/s, RSS " << rss0 << " -> " << rssMB() << " MB\n";
+
     return EXIT_SUCCESS;
 }
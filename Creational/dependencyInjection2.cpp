@@ -0,0 +1,484 @@
+/*
+Dependency Injection with a compile-time container.
+
+The Injector in dependencyInjection0.cpp wires every Client by hand. Here the
+wiring is derived from constructor signatures instead: a class marks its
+injection constructor with INJECT(...), the container is a list of bindings
+(interface -> implementation, lifetime) given as template arguments, and
+resolve<T>() walks the dependency graph while compiling. A resolve compiles
+down to constructing the objects directly - there is no map lookup, no type
+erasure and no RTTI at run-time, only a "constructed yet?" branch for shared
+instances. Missing bindings or a scoped service requested outside a scope are
+compile errors; so is a singleton that depends on a scoped service, because
+a singleton's dependencies are always resolved outside any scope.
+
+Lifetimes:
+
+    --Singleton: one instance per container, built on first use.
+    --Scoped: one instance per Container::Scope (e.g. per request).
+    --Transient: a new instance for every injection, owned by the client
+    through std::unique_ptr.
+
+Dependencies are declared as T& for singleton and scoped services and as
+std::unique_ptr<T> for transient ones. Classes without a binding are built
+by value (that is how a Client is resolved).
+
+A Scope is meant to be cheap enough to open per request: every scoped service
+is placed in the scope's monotonic arena (an inline buffer that overflows to
+the heap), singletons are shared from the parent container, and closing the
+scope runs the destructors that are not trivial and drops the arena in one
+go instead of freeing each object.
+
+Threads may share one container: a singleton is built exactly once even when
+several threads resolve it first at the same time (one acquire load once it
+exists, std::call_once before that). A Scope belongs to one thread at a time.
+*/
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <new>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/* Declares the injection constructor and records its signature */
+#define INJECT(signature) using Inject = signature; signature
+
+//interface serviceA
+class ServiceA
+{
+    public:
+        virtual ~ServiceA() {}
+        virtual void executeService() = 0;
+};
+//interface serviceB
+class ServiceB
+{
+    public:
+        virtual ~ServiceB() {}
+        virtual void executeService() = 0;
+};
+//interface serviceC
+class ServiceC
+{
+    public:
+        virtual ~ServiceC() {}
+        virtual void executeService() = 0;
+};
+
+//ServiceA1 realizes/implements ServiceA
+class ServiceA1 : public ServiceA
+{
+    public:
+        void executeService() override { std::cout << "serviceA1 is working\n"; }
+};
+//ServiceB1 realizes/implements ServiceB, and itself depends on ServiceA
+class ServiceB1 : public ServiceB
+{
+    public:
+        INJECT(ServiceB1(ServiceA& a)) : a(a) {}
+        void executeService() override { std::cout << "serviceB1 is working\n"; }
+    private:
+        ServiceA& a;
+};
+//ServiceC1 realizes/implements ServiceC
+class ServiceC1 : public ServiceC
+{
+    public:
+        void executeService() override { std::cout << "serviceC1 is working\n"; }
+};
+
+class Client
+{
+    private:
+        // Internal reference to services used by client.
+        ServiceA& service1;
+        ServiceB& service2;
+        std::unique_ptr<ServiceC> service3;
+    public:
+        //constructor injection, dependencies are resolved from this signature
+        INJECT(Client(ServiceA& service1, ServiceB& service2, std::unique_ptr<ServiceC> service3))
+            : service1(service1), service2(service2), service3(std::move(service3)) {}
+        void callServices() const {
+           std::cout << "Client::services called\n";
+           service1.executeService();
+           service2.executeService();
+           service3->executeService();
+        }
+        const void* serviceB() const { return &service2; }
+};
+
+/* Lifetimes */
+struct Singleton {};
+struct Scoped {};
+struct Transient {};
+
+/* Binding of an interface to an implementation with a lifetime */
+template <class I, class Impl, class Lifetime>
+struct Bind
+{
+    static_assert(std::is_base_of<I, Impl>::value, "Impl must implement I");
+    typedef I        Interface;
+    typedef Impl     Implementation;
+    typedef Lifetime Life;
+};
+
+/* Constructor signature of T: T::Inject, or the default constructor */
+template <class T, class = void>
+struct InjectOf { typedef T Signature(); };
+template <class T>
+struct InjectOf<T, std::void_t<typename T::Inject>> { typedef typename T::Inject Signature; };
+/* Null pointer to the signature, used to deduce the argument types */
+template <class T>
+using SignatureTag = typename InjectOf<T>::Signature*;
+
+/* Position of the binding for I in Bindings..., -1 when unbound */
+template <class I, class... Bindings>
+constexpr int bindingIndex()
+{
+    int index = 0, found = -1;
+    ((std::is_same<I, typename Bindings::Interface>::value ? (found = index, ++index) : ++index), ...);
+    return found;
+}
+
+template <class> struct IsUniquePtr : std::false_type {};
+template <class T> struct IsUniquePtr<std::unique_ptr<T>> : std::true_type { typedef T Element; };
+
+template <class> constexpr bool alwaysFalse = false;
+
+/* A singleton instance, built once on first use by whichever thread is first */
+template <class T>
+struct LazyInstance
+{
+    std::atomic<bool> ready{false};
+    std::once_flag once;
+    std::optional<T> value;
+};
+
+template <class... Bindings>
+class Container
+{
+    template <class B>
+    using Slot = LazyInstance<typename B::Implementation>;
+    typedef std::tuple<Slot<Bindings>...> Slots;
+
+    public:
+        /* Scoped services live in the Scope's arena as long as the Scope */
+        class Scope
+        {
+            public:
+                static const std::size_t inlineBytes = 2048;
+
+                explicit Scope(Container& parent)
+                    : parent(parent), arena(buffer, sizeof(buffer)), cleanup(&arena) {}
+                Scope(const Scope&) = delete;
+                ~Scope()
+                {
+                    for (auto it = cleanup.rbegin(); it != cleanup.rend(); ++it)
+                        it->destroy(it->object);
+                    // the arena releases all memory at once in its destructor
+                }
+                template <class T>
+                decltype(auto) resolve() { return parent.resolveIn<T, true>(this); }
+            private:
+                friend class Container;
+                struct Cleanup
+                {
+                    void* object;
+                    void (*destroy)(void*);
+                };
+
+                Container& parent;
+                alignas(std::max_align_t) std::byte buffer[inlineBytes];
+                std::pmr::monotonic_buffer_resource arena;
+                std::pmr::vector<Cleanup> cleanup;
+                std::tuple<typename Bindings::Implementation*...> scoped;
+        };
+
+        Container() {}
+        Container(const Container&) = delete;
+
+        template <class T>
+        decltype(auto) resolve() { return resolveIn<T, false>(nullptr); }
+
+    private:
+        template <class T, bool InScope>
+        decltype(auto) resolveIn(Scope* scope)
+        {
+            constexpr int index = bindingIndex<T, Bindings...>();
+            if constexpr (index < 0)
+            {
+                static_assert(!std::is_abstract<T>::value, "no binding for this interface");
+                return construct<T, InScope>(SignatureTag<T>(), scope);
+            }
+            else
+            {
+                typedef std::tuple_element_t<index, std::tuple<Bindings...>> B;
+                typedef typename B::Implementation Impl;
+                typedef typename B::Life Life;
+                if constexpr (std::is_same<Life, Transient>::value)
+                {
+                    return std::unique_ptr<T>(make<Impl, InScope>(SignatureTag<Impl>(), scope));
+                }
+                else if constexpr (std::is_same<Life, Singleton>::value)
+                {
+                    /* outlives every scope, so its dependencies must too */
+                    return static_cast<T&>(shared(std::get<index>(singletons), SignatureTag<Impl>()));
+                }
+                else
+                {
+                    static_assert(InScope || alwaysFalse<T>, "scoped service resolved outside a Scope");
+                    if constexpr (InScope)
+                    {
+                        Impl*& slot = std::get<index>(scope->scoped);
+                        if (slot == nullptr)
+                            slot = place(SignatureTag<Impl>(), scope);
+                        return static_cast<T&>(*slot);
+                    }
+                }
+            }
+        }
+
+        /* One constructor argument: T& or std::unique_ptr<T> */
+        template <class Arg, bool InScope>
+        decltype(auto) argument(Scope* scope)
+        {
+            if constexpr (std::is_lvalue_reference<Arg>::value)
+            {
+                typedef std::remove_cv_t<std::remove_reference_t<Arg>> T;
+                static_assert(std::is_lvalue_reference<decltype(resolveIn<T, InScope>(scope))>::value,
+                              "transient services are injected as std::unique_ptr");
+                return resolveIn<T, InScope>(scope);
+            }
+            else
+            {
+                static_assert(IsUniquePtr<Arg>::value, "inject T& or std::unique_ptr<T>");
+                return resolveIn<typename IsUniquePtr<Arg>::Element, InScope>(scope);
+            }
+        }
+
+        template <class T, bool InScope, class... Args>
+        T construct(T (*)(Args...), [[maybe_unused]] Scope* scope)
+        {
+            return T(argument<Args, InScope>(scope)...);
+        }
+        template <class T, bool InScope, class... Args>
+        T* make(T (*)(Args...), [[maybe_unused]] Scope* scope)
+        {
+            return new T(argument<Args, InScope>(scope)...);
+        }
+        /* Builds T in the scope's arena */
+        template <class T, class... Args>
+        T* place(T (*)(Args...), Scope* scope)
+        {
+            void* memory = scope->arena.allocate(sizeof(T), alignof(T));
+            T* object = new (memory) T(argument<Args, true>(scope)...);
+            if constexpr (!std::is_trivially_destructible<T>::value)
+                scope->cleanup.push_back({ object, [](void* o) { static_cast<T*>(o)->~T(); } });
+            return object;
+        }
+        template <class T, class... Args>
+        T& shared(LazyInstance<T>& slot, T (*)(Args...))
+        {
+            if (!slot.ready.load(std::memory_order_acquire)) [[unlikely]]
+                std::call_once(slot.once, [&] {
+                    slot.value.emplace(argument<Args, false>(nullptr)...);
+                    slot.ready.store(true, std::memory_order_release);
+                });
+            return *slot.value;
+        }
+
+        Slots singletons;
+};
+
+/* A conventional container for comparison: factories in a map keyed by type */
+class RuntimeContainer
+{
+    public:
+        template <class I, class Impl>
+        void bindSingleton()
+        {
+            factories[typeid(I)] = [this](RuntimeContainer&) -> std::shared_ptr<void> {
+                std::type_index key = typeid(I);
+                auto it = instances.find(key);
+                if (it == instances.end())
+                    it = instances.emplace(key, std::shared_ptr<I>(std::make_shared<Impl>())).first;
+                return it->second;
+            };
+        }
+        template <class T, class F>
+        void bindFactory(F f)
+        {
+            factories[typeid(T)] = [f](RuntimeContainer& c) -> std::shared_ptr<void> { return f(c); };
+        }
+        template <class T>
+        std::shared_ptr<T> resolve()
+        {
+            return std::static_pointer_cast<T>(factories.at(typeid(T))(*this));
+        }
+    private:
+        std::unordered_map<std::type_index, std::function<std::shared_ptr<void>(RuntimeContainer&)>> factories;
+        std::unordered_map<std::type_index, std::shared_ptr<void>> instances;
+};
+
+typedef Container<Bind<ServiceA, ServiceA1, Singleton>,
+                  Bind<ServiceB, ServiceB1, Scoped>,
+                  Bind<ServiceC, ServiceC1, Transient>> AppContainer;
+
+/* A request-scoped object graph, as a web handler would need it */
+struct RequestContext
+{
+    RequestContext() : requestId(++counter) { std::snprintf(path, sizeof(path), "/orders/%llu", requestId); }
+    char path[64];
+    unsigned long long requestId;
+    static unsigned long long counter;
+};
+unsigned long long RequestContext::counter = 0;
+
+struct UserSession
+{
+    INJECT(UserSession(RequestContext& request)) : request(request), userId(request.requestId % 1000) {}
+    RequestContext& request;
+    unsigned long long userId;
+    char roles[32] = "reader,writer";
+};
+
+struct Authorizer
+{
+    INJECT(Authorizer(UserSession& session, ServiceA& policy)) : session(session), policy(policy) {}
+    bool allowed() const { return session.userId % 7 != 0; }
+    UserSession& session;
+    ServiceA& policy;
+};
+
+struct Repository
+{
+    INJECT(Repository(RequestContext& request)) : request(request), table("orders") {}
+    unsigned long long find() const { return request.requestId * 31 + table.size(); }
+    RequestContext& request;
+    std::string table;      // not trivially destructible: cleaned up by the Scope
+};
+
+struct AuditLog
+{
+    INJECT(AuditLog(RequestContext& request, UserSession& session)) : request(request), session(session), count(0) {}
+    void record(unsigned long long what) { entries[count++ % 8] = what; }
+    RequestContext& request;
+    UserSession& session;
+    unsigned long long entries[8];
+    unsigned count;
+};
+
+class Handler
+{
+    public:
+        INJECT(Handler(Authorizer& auth, Repository& repo, AuditLog& log)) : auth(auth), repo(repo), log(log) {}
+        unsigned long long handle()
+        {
+            unsigned long long result = auth.allowed() ? repo.find() : 0;
+            log.record(result);
+            return result;
+        }
+    private:
+        Authorizer& auth;
+        Repository& repo;
+        AuditLog& log;
+};
+
+typedef Container<Bind<ServiceA, ServiceA1, Singleton>,
+                  Bind<RequestContext, RequestContext, Scoped>,
+                  Bind<UserSession, UserSession, Scoped>,
+                  Bind<Authorizer, Authorizer, Scoped>,
+                  Bind<Repository, Repository, Scoped>,
+                  Bind<AuditLog, AuditLog, Scoped>> RequestContainer;
+
+int main()
+{
+    AppContainer container;
+    {
+        AppContainer::Scope request(container);
+        Client client = request.resolve<Client>();
+        client.callServices();
+        std::cout << "same ServiceB within a scope: "
+                  << (request.resolve<Client>().serviceB() == client.serviceB()) << std::endl;
+
+        AppContainer::Scope other(container);
+        std::cout << "same ServiceB in another scope: "
+                  << (other.resolve<Client>().serviceB() == client.serviceB()) << std::endl;
+    }
+    std::cout << "same ServiceA for the container: "
+              << (&container.resolve<ServiceA>() == &container.resolve<ServiceA>()) << std::endl;
+    // container.resolve<ServiceB>(); // compile error: scoped service resolved outside a Scope
+    std::cout << std::endl;
+
+    /* Resolve cost: singleton lookup and transient creation */
+    RuntimeContainer runtime;
+    runtime.bindSingleton<ServiceA, ServiceA1>();
+    runtime.bindFactory<ServiceC>([](RuntimeContainer&) { return std::make_shared<ServiceC1>(); });
+
+    const int n = 5000000;
+    typedef std::chrono::steady_clock clock;
+    typedef std::chrono::duration<double, std::nano> ns;
+    std::size_t sink = 0;
+
+    auto t0 = clock::now();
+    for (int i = 0; i < n; i++)
+        sink += reinterpret_cast<std::size_t>(&container.resolve<ServiceA>());
+    auto t1 = clock::now();
+    for (int i = 0; i < n; i++)
+        sink += reinterpret_cast<std::size_t>(runtime.resolve<ServiceA>().get());
+    auto t2 = clock::now();
+    for (int i = 0; i < n; i++)
+        sink += reinterpret_cast<std::size_t>(container.resolve<ServiceC>().get()) & 1;
+    auto t3 = clock::now();
+    for (int i = 0; i < n; i++)
+        sink += reinterpret_cast<std::size_t>(runtime.resolve<ServiceC>().get()) & 1;
+    auto t4 = clock::now();
+
+    std::cout << "singleton resolve: compile-time " << ns(t1 - t0).count() / n
+              << " ns, runtime map " << ns(t2 - t1).count() / n << " ns" << std::endl;
+    std::cout << "transient resolve: compile-time " << ns(t3 - t2).count() / n
+              << " ns, runtime map " << ns(t4 - t3).count() / n << " ns" << std::endl;
+    std::cout << "(" << (sink & 1) << ")" << std::endl;
+
+    /* Requests per second: arena-backed scopes against wiring with new */
+    RequestContainer requests;
+    const int r = 2000000;
+    auto t5 = clock::now();
+    for (int i = 0; i < r; i++)
+    {
+        RequestContainer::Scope scope(requests);
+        sink += scope.resolve<Handler>().handle();
+    }
+    auto t6 = clock::now();
+    ServiceA1 policy;
+    for (int i = 0; i < r; i++)
+    {
+        RequestContext* request = new RequestContext;
+        UserSession* session = new UserSession(*request);
+        Authorizer* auth = new Authorizer(*session, policy);
+        Repository* repo = new Repository(*request);
+        AuditLog* log = new AuditLog(*request, *session);
+        sink += Handler(*auth, *repo, *log).handle();
+        delete log;
+        delete repo;
+        delete auth;
+        delete session;
+        delete request;
+    }
+    auto t7 = clock::now();
+    typedef std::chrono::duration<double> seconds;
+    std::cout << "requests/s: scope arena " << r / seconds(t6 - t5).count() / 1e6
+              << " M, heap " << r / seconds(t7 - t6).count() / 1e6 << " M (" << (sink & 1) << ")" << std::endl;
+
+    return EXIT_SUCCESS;
+}
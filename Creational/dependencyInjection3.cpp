@@ -0,0 +1,326 @@
+/*
+Dependency Injection with parallel service startup.
+
+Injector::constructionInjectionClient() in dependencyInjection0.cpp builds
+every service one after the other. In a real application with dozens of
+services startup time is then the sum of all constructors, even though most
+services do not depend on each other.
+
+This Injector registers each service with the names of the services it
+depends on. start() builds the dependency DAG and constructs services on a
+thread pool in topological order: a service is scheduled as soon as all its
+dependencies exist, so independent slow services are built concurrently and
+cold start approaches the critical path (the slowest chain of dependent
+constructors) instead of the sum. start() returns a StartupReport with the
+construction time of every service and the critical path.
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <cstdlib>
+
+//interface serviceA
+class ServiceA
+{
+    public:
+        virtual ~ServiceA() {}
+        virtual void executeService() = 0;
+};
+//interface serviceB
+class ServiceB
+{
+    public:
+        virtual ~ServiceB() {}
+        virtual void executeService() = 0;
+};
+
+//ServiceA1 realizes/implements ServiceA
+class ServiceA1 : public ServiceA
+{
+    public:
+        void executeService() override { std::cout << "serviceA1 is working\n"; }
+};
+//ServiceB1 realizes/implements ServiceB
+class ServiceB1 : public ServiceB
+{
+    public:
+        void executeService() override { std::cout << "serviceB1 is working\n"; }
+};
+
+class Client  {
+    private:
+        // Internal reference to services used by client.
+        ServiceA * service1;
+        ServiceB * service2;
+    public:
+        //constructor injection, dependencies are provided through class constructor
+        Client(ServiceA * service1, ServiceB * service2) : service1(service1), service2(service2) {}
+        void callServices() const{
+           std::cout << "Client::services called\n";
+           service1->executeService();
+           service2->executeService();
+       }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/* What start() measured */
+struct StartupReport
+{
+    struct Entry
+    {
+        std::string name;
+        double startMs;     // relative to start()
+        double durationMs;  // time spent in the factory
+    };
+    std::vector<Entry> services;        // in registration order
+    std::vector<std::string> criticalPath;
+    double criticalPathMs;
+    double sumMs;
+    double wallMs;
+
+    void print(std::ostream& out, bool perService = true) const
+    {
+        if (perService)
+            for (const Entry& e : services)
+                out << std::setw(12) << e.name << " start " << std::setw(8) << e.startMs
+                    << " ms, took " << std::setw(8) << e.durationMs << " ms\n";
+        out << "critical path (" << criticalPathMs << " ms):";
+        for (const std::string& name : criticalPath)
+            out << " " << name;
+        out << "\nwall " << wallMs << " ms, sum of services " << sumMs << " ms\n";
+    }
+};
+
+class Injector
+{
+    public:
+        typedef std::function<std::shared_ptr<void>(Injector&)> Factory;
+
+        /* factory may get<>() any of deps, they are built before it runs */
+        void registerService(const std::string& name, std::vector<std::string> deps, Factory factory)
+        {
+            index[name] = nodes.size();
+            nodes.push_back(Node{ name, std::move(deps), std::move(factory) });
+        }
+        template <class T>
+        T* get(const std::string& name)
+        {
+            return static_cast<T*>(nodes.at(index.at(name)).instance.get());
+        }
+
+        /* Builds every registered service using up to `threads` threads. If a
+           factory throws, nothing new is started, every thread is joined and
+           the first exception is rethrown here. */
+        StartupReport start(unsigned threads)
+        {
+            std::size_t n = nodes.size();
+            std::vector<std::vector<std::size_t>> dependents(n);
+            std::vector<std::size_t> waitingFor(n);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                for (const std::string& dep : nodes[i].deps)
+                {
+                    auto it = index.find(dep);
+                    if (it == index.end())
+                        throw std::invalid_argument(nodes[i].name + " depends on unknown " + dep);
+                    dependents[it->second].push_back(i);
+                }
+                waitingFor[i] = nodes[i].deps.size();
+            }
+
+            std::mutex m;
+            std::condition_variable cv;
+            std::deque<std::size_t> ready;
+            std::size_t built = 0, running = 0;
+            std::exception_ptr failure;     // first factory that threw
+            for (std::size_t i = 0; i < n; i++)
+                if (waitingFor[i] == 0)
+                    ready.push_back(i);
+
+            Clock::time_point t0 = Clock::now();
+            auto worker = [&] {
+                std::unique_lock<std::mutex> lock(m);
+                for (;;)
+                {
+                    cv.wait(lock, [&] { return !ready.empty() || running == 0; });
+                    if (ready.empty())
+                        return;     // nothing ready and nothing running: done (or a cycle)
+                    std::size_t i = ready.front();
+                    ready.pop_front();
+                    running++;
+                    lock.unlock();
+
+                    Clock::time_point begin = Clock::now();
+                    std::exception_ptr error;
+                    try { nodes[i].instance = nodes[i].factory(*this); }
+                    catch (...) { error = std::current_exception(); }
+                    Clock::time_point end = Clock::now();
+
+                    lock.lock();
+                    if (error)
+                    {
+                        /* start nothing new; the others finish what they run */
+                        if (!failure)
+                            failure = error;
+                        ready.clear();
+                        running--;
+                        cv.notify_all();
+                        continue;
+                    }
+                    if (failure)
+                    {
+                        running--;
+                        cv.notify_all();
+                        continue;
+                    }
+                    nodes[i].start = begin - t0;
+                    nodes[i].duration = end - begin;
+                    running--;
+                    built++;
+                    for (std::size_t d : dependents[i])
+                        if (--waitingFor[d] == 0)
+                            ready.push_back(d);
+                    cv.notify_all();
+                }
+            };
+            std::vector<std::thread> pool;
+            for (unsigned t = 1; t < threads; t++)
+                pool.emplace_back(worker);
+            worker();
+            for (std::thread& t : pool)
+                t.join();
+            double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+            if (failure)
+                std::rethrow_exception(failure);
+            if (built != n)
+                throw std::logic_error("dependency cycle between services");
+            return report(dependents, wallMs);
+        }
+
+    private:
+        struct Node
+        {
+            std::string name;
+            std::vector<std::string> deps;
+            Factory factory;
+            std::shared_ptr<void> instance = nullptr;
+            std::chrono::duration<double, std::milli> start{}, duration{};
+        };
+
+        /* Longest chain of construction times through the DAG: a node
+           finishes its own duration after the latest of its dependencies.
+           Ties go to the dependency registered first, so the path is the
+           same for the same durations, however the threads were scheduled */
+        StartupReport report(const std::vector<std::vector<std::size_t>>& dependents, double wallMs)
+        {
+            std::size_t n = nodes.size();
+            StartupReport r;
+            r.sumMs = 0;
+            r.wallMs = wallMs;
+            /* topological order of the DAG (Kahn), in registration order
+               among nodes that become ready together */
+            std::vector<std::size_t> waitingFor(n), order;
+            order.reserve(n);
+            for (std::size_t i = 0; i < n; i++)
+                if ((waitingFor[i] = nodes[i].deps.size()) == 0)
+                    order.push_back(i);
+            for (std::size_t k = 0; k < order.size(); k++)
+                for (std::size_t d : dependents[order[k]])
+                    if (--waitingFor[d] == 0)
+                        order.push_back(d);
+            std::vector<double> finish(n, 0);
+            std::vector<std::size_t> previous(n, n);
+            for (std::size_t i : order)
+            {
+                for (const std::string& dep : nodes[i].deps)
+                {
+                    std::size_t j = index.at(dep);
+                    if (previous[i] == n || finish[j] > finish[previous[i]])
+                        previous[i] = j;
+                }
+                finish[i] = nodes[i].duration.count() + (previous[i] == n ? 0 : finish[previous[i]]);
+            }
+            std::size_t last = std::max_element(finish.begin(), finish.end()) - finish.begin();
+            r.criticalPathMs = n ? finish[last] : 0;
+            for (std::size_t i = last; n && i != n; i = previous[i])
+                r.criticalPath.insert(r.criticalPath.begin(), nodes[i].name);
+            for (const Node& node : nodes)
+            {
+                r.services.push_back({ node.name, node.start.count(), node.duration.count() });
+                r.sumMs += node.duration.count();
+            }
+            return r;
+        }
+
+        std::vector<Node> nodes;
+        std::map<std::string, std::size_t> index;
+};
+
+/* Stand-in for a service whose constructor takes `ms` milliseconds */
+struct SlowService
+{
+    explicit SlowService(int ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+};
+
+int main()
+{
+    Injector injector;
+    injector.registerService("sa1", {}, [](Injector&) { return std::make_shared<ServiceA1>(); });
+    injector.registerService("sb1", {}, [](Injector&) { return std::make_shared<ServiceB1>(); });
+    injector.registerService("client", { "sa1", "sb1" }, [](Injector& inj) {
+        return std::make_shared<Client>(inj.get<ServiceA1>("sa1"), inj.get<ServiceB1>("sb1"));
+    });
+    injector.start(2).print(std::cout);
+    injector.get<Client>("client")->callServices();
+    std::cout << std::endl;
+
+    /* 80 services: most are quick, a few slow ones are independent */
+    auto build = [](Injector& inj) {
+        unsigned seed = 12345;
+        for (int i = 0; i < 80; i++)
+        {
+            std::vector<std::string> deps;
+            int ms = 2;
+            if (i % 16 == 5)
+                ms = 120;       // slow, depends on nothing
+            else
+                for (int d = 0; d < i && deps.size() < 3; d++)
+                    if ((seed = seed * 1103515245u + 12345u) % 20 == 0 && d % 16 != 5)
+                        deps.push_back("svc" + std::to_string(d));
+            inj.registerService("svc" + std::to_string(i), deps,
+                                [ms](Injector&) { return std::make_shared<SlowService>(ms); });
+        }
+    };
+    for (unsigned threads : { 1u, 8u })
+    {
+        Injector services;
+        build(services);
+        std::cout << "80 services, " << threads << " thread(s):\n";
+        services.start(threads).print(std::cout, false);
+    }
+
+    /* a factory that throws stops startup; start() rethrows after joining */
+    Injector broken;
+    build(broken);
+    broken.registerService("config", { "svc3" }, [](Injector&) -> std::shared_ptr<void> {
+        throw std::runtime_error("config file missing");
+    });
+    try { broken.start(8); }
+    catch (const std::exception& e) { std::cout << "start failed: " << e.what() << std::endl; }
+
+    return EXIT_SUCCESS;
+}
@@ -1,21 +1,175 @@
+/*
+ Object adapter whose bindings can be swapped while in use.
+
+ Adapter::attach() and Client::attach() used to overwrite plain pointers, so
+ rebinding while another thread was inside useTargetInterface() was a data
+ race and the old adaptee could never be freed. Both bindings are now
+ RcuPointers: a reader follows one with a single atomic load and no lock, and
+ attach() publishes the new object and retires the old one. Retired objects
+ are deleted once every registered reader thread has passed a quiescent
+ point (Rcu::Reader::quiescent(), called between operations), because no
+ reader can still hold the old pointer after that.
+*/
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+
+/* Printing is switched off while benchmarking */
+std::atomic<bool> tracing{true};
+
+/* Quiescent-state based reclamation shared by all RcuPointers */
+class Rcu
+{
+    struct Slot;
+    public:
+        static const int MaxReaders = 64;
+
+        static Rcu& instance()
+        {
+            static Rcu rcu;
+            return rcu;
+        }
+        ~Rcu()
+        {
+            for (Retired& r : retired)
+                r.reclaim();
+        }
+
+        /* Registers the calling thread as a reader for its lifetime */
+        class Reader
+        {
+            public:
+                Reader() : rcu(Rcu::instance()), slot(nullptr)
+                {
+                    for (Slot& s : rcu.slots)
+                        if (!s.used.exchange(true)) { slot = &s; break; }
+                    if (slot == nullptr)
+                        throw std::runtime_error("too many RCU readers");
+                    slot->epoch.store(rcu.epoch.load(), std::memory_order_seq_cst);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                }
+                ~Reader()
+                {
+                    slot->epoch.store(Offline, std::memory_order_release);
+                    slot->used.store(false, std::memory_order_release);
+                }
+                Reader(const Reader&) = delete;
+                Reader& operator=(const Reader&) = delete;
+                /* call between operations: no pointer loaded before is used after */
+                void quiescent()
+                {
+                    slot->epoch.store(rcu.epoch.load(std::memory_order_acquire), std::memory_order_release);
+                }
+            private:
+                Rcu& rcu;
+                Slot* slot;
+        };
+
+        /* reclaim() runs once no reader can reach what it frees */
+        void retire(std::function<void()> reclaim)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            std::uint64_t e = epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+            retired.push_back({ e, std::move(reclaim) });
+            collect();
+        }
+        std::size_t pending()
+        {
+            std::lock_guard<std::mutex> lock(m);
+            collect();
+            return retired.size();
+        }
+        std::uint64_t reclaimed() const { return freed.load(); }
+
+    private:
+        static const std::uint64_t Offline = ~std::uint64_t(0);
+        struct alignas(64) Slot
+        {
+            std::atomic<std::uint64_t> epoch{Offline};
+            std::atomic<bool> used{false};
+        };
+        struct Retired
+        {
+            std::uint64_t epoch;
+            std::function<void()> reclaim;
+        };
+        /* frees everything retired before the oldest reader's epoch; m held */
+        void collect()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::uint64_t oldest = Offline;
+            for (Slot& s : slots)
+                oldest = std::min(oldest, s.epoch.load(std::memory_order_acquire));
+            while (!retired.empty() && retired.front().epoch <= oldest)
+            {
+                retired.front().reclaim();
+                retired.pop_front();
+                freed++;
+            }
+        }
+
+        std::atomic<std::uint64_t> epoch{1};
+        Slot slots[MaxReaders];
+        std::mutex m;
+        std::deque<Retired> retired;
+        std::atomic<std::uint64_t> freed{0};
+};
+
+/* Owning pointer that readers load without locking */
+template <class T>
+class RcuPointer
+{
+    public:
+        ~RcuPointer() { delete p.load(); }
+        T* load() const { return p.load(std::memory_order_acquire); }
+        void store(std::unique_ptr<T> next)
+        {
+            T* old = p.exchange(next.release(), std::memory_order_acq_rel);
+            if (old != nullptr)
+                Rcu::instance().retire([old] { delete old; });
+        }
+    private:
+        std::atomic<T*> p{nullptr};
+};
 
 /* Adaptee (source) interface */
 class AdapteeInterface
 {
     public:
+        virtual ~AdapteeInterface() {}
         virtual void specificOperation() = 0;
 };
 
 class Adaptee : public AdapteeInterface
 {
     public:
-        void specificOperation() override { std::cout << "Adaptee specificOperation())\n"; }
+        explicit Adaptee(int version = 1) : version(version) {}
+        void specificOperation() override
+        {
+            if (tracing.load(std::memory_order_relaxed))
+                std::cout << "Adaptee " << version << " specificOperation())\n";
+            served += version;
+        }
+        static thread_local long served;    // sum of versions that served this thread
+    private:
+        int version;
 };
+thread_local long Adaptee::served = 0;
 
 class TargetInterface
 {
     public:
+        virtual ~TargetInterface() {}
         virtual void operation() = 0;
 };
 
@@ -23,40 +177,102 @@ class TargetInterface
 class Adapter : public TargetInterface
 {
     public:
-        void attach(AdapteeInterface* outlet) { adaptee = outlet; }
+        void attach(std::unique_ptr<AdapteeInterface> outlet) { adaptee.store(std::move(outlet)); }
         void operation() override {
-            std::cout << "Adapter operation()\n";
-            adaptee->specificOperation();
+            if (tracing.load(std::memory_order_relaxed))
+                std::cout << "Adapter operation()\n";
+            adaptee.load()->specificOperation();
         }
     private:
-        AdapteeInterface* adaptee;
+        RcuPointer<AdapteeInterface> adaptee;
 };
 
 class Client
 {
     public:
-        void attach(TargetInterface* x)  { ti = x; }
+        void attach(std::unique_ptr<TargetInterface> x)  { ti.store(std::move(x)); }
         void useTargetInterface() {
-            std::cout << "Client time!" << std::endl;
-            ti->operation();
+            if (tracing.load(std::memory_order_relaxed))
+                std::cout << "Client time!" << std::endl;
+            ti.load()->operation();
         }
     private:
-        TargetInterface* ti;
+        RcuPointer<TargetInterface> ti;
 };
 
-
 int main()
 {
-    Adaptee* adaptee = new Adaptee;
+    Rcu::Reader reader;
     Adapter* adapter = new Adapter;
     Client* cl = new Client;
 
     /* attaching to adaptee */
-    adapter->attach(adaptee);
-    cl->attach(adapter);
+    adapter->attach(std::unique_ptr<AdapteeInterface>(new Adaptee));
+    cl->attach(std::unique_ptr<TargetInterface>(adapter));
 
     /* target interface usage from client */
     cl->useTargetInterface();
 
+    /* rebinding frees the old adaptee once this reader is quiescent */
+    adapter->attach(std::unique_ptr<AdapteeInterface>(new Adaptee(2)));
+    cl->useTargetInterface();
+    reader.quiescent();
+    std::cout << "retired objects still pending: " << Rcu::instance().pending() << "\n\n";
+
+    /* Reader throughput with and without a writer swapping bindings */
+    tracing = false;
+    const int readers = 2;
+    for (bool swapping : { false, true })
+    {
+        std::atomic<bool> stop{false};
+        std::atomic<long> reads{0};
+        long swaps = 0;
+        std::vector<std::thread> threads;
+        for (int r = 0; r < readers; r++)
+            threads.emplace_back([&] {
+                Rcu::Reader self;
+                long n = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (int i = 0; i < 256; i++)
+                    {
+                        cl->useTargetInterface();
+                        self.quiescent();
+                    }
+                    n += 256;
+                }
+                reads += n;
+            });
+        auto start = std::chrono::steady_clock::now();
+        if (swapping)
+            while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+            {
+                ++swaps;
+                /* mostly new adaptees, now and then a whole new adapter */
+                if (swaps % 16)
+                    adapter->attach(std::unique_ptr<AdapteeInterface>(new Adaptee(swaps % 7 + 1)));
+                else
+                {
+                    std::unique_ptr<Adapter> next(new Adapter);
+                    next->attach(std::unique_ptr<AdapteeInterface>(new Adaptee(1)));
+                    adapter = next.get();
+                    cl->attach(std::move(next));
+                }
+                reader.quiescent();
+            }
+        else
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        stop = true;
+        for (std::thread& t : threads)
+            t.join();
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << readers << " readers, " << (swapping ? "writer swapping: " : "no writer:       ")
+                  << reads / sec / 1e6 << " M reads/s, " << swaps / sec << " swaps/s\n";
+    }
+    reader.quiescent();
+    std::cout << "reclaimed " << Rcu::instance().reclaimed() << " objects, "
+              << Rcu::instance().pending() << " pending" << std::endl;
+
+    delete cl;
     return EXIT_SUCCESS;
 }
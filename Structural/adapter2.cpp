@@ -1,46 +1,482 @@
+/*
+ Adapter with batch operations.
+
+ A simulation tick acts for every unit, and calling fireWeapon() once per unit
+ costs a virtual call and a console write each. EnemyAttacker therefore also
+ has batch forms: one call acts for a whole span of units of the same kind and
+ writes each unit's result into the span instead of printing it. The adapter
+ translates such a batch into the adaptee's own bulk form (EnemyRobot's
+ meleeSmash/walkForward over a span), so a tick runs as a few tight loops.
+
+ Rolls come from Dice instead of rand(): eight interleaved xoshiro256**
+ lanes that the compiler can vectorize, with bounded rolls by Lemire's
+ multiply-shift method (rare biased candidates are rejected, not folded in by
+ modulo). Every thread has its own Dice, and Dice::streams() derives
+ non-overlapping streams by jump-ahead, so work split into fixed chunks - one
+ stream per chunk - rolls the same numbers whatever the thread count. Units
+ and the adaptee only see the Roller interface: they are given one (or roll
+ from the calling thread's Dice when they are not), so a test can plug in
+ fixed rolls.
+
+ For large battles UnitStore keeps the units of each kind in struct-of-arrays
+ columns (position, damage range, last damage, driver id) instead of one
+ object per unit. EnemyAttacker's column forms take a UnitSlice - the same
+ rows of every column - so one EnemyTank and one EnemyRobotAdapter serve all
+ rows of their kind, and the adapter just maps columns onto EnemyRobot's bulk
+ walkForward/meleeSmash. A tick cuts every kind into fixed chunks and runs
+ them on a TickPool; chunk k always rolls from dice stream k.
+
+ Per-unit actions do not write to std::cout themselves: they push a compact
+ binary Event into the calling thread's ring in the EventLog, and a
+ background writer formats the events of all rings and writes them in
+ batches. A full ring makes the producer wait, so no event is dropped;
+ EventLog::flush() returns once everything pushed so far is written. When a
+ thread exits its ring goes back to the log and the next new thread takes it
+ over, so the rings never outnumber the threads that were alive at once.
+*/
 #include <iostream>
+#include <string>
+#include <span>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <barrier>
+#include <memory>
+#include <mutex>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
 #include <ctime>
+#include <cstdint>
 #include <cstdlib>
 
+// xoshiro256** (Blackman & Vigna), seeded through splitmix64
+class Xoshiro256 {
+	public:
+		explicit Xoshiro256(std::uint64_t seed) {
+			for (std::uint64_t& word : s) {
+				std::uint64_t z = (seed += 0x9e3779b97f4a7c15);
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+				word = z ^ (z >> 31);
+			}
+		}
+		std::uint64_t operator()() {
+			std::uint64_t result = rotl(s[1] * 5, 7) * 9;
+			std::uint64_t t = s[1] << 17;
+			s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = rotl(s[3], 45);
+			return result;
+		}
+		// same as 2^128 / 2^192 calls of operator()
+		void jump() {
+			static const std::uint64_t poly[4] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+			advance(poly);
+		}
+		void longJump() {
+			static const std::uint64_t poly[4] = { 0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635 };
+			advance(poly);
+		}
+		const std::uint64_t* state() const { return s; }
+
+		static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+	private:
+		void advance(const std::uint64_t (&poly)[4]) {
+			std::uint64_t t[4] = {};
+			for (std::uint64_t word : poly)
+				for (int b = 0; b < 64; b++) {
+					if (word & std::uint64_t(1) << b)
+						for (int i = 0; i < 4; i++)
+							t[i] ^= s[i];
+					(*this)();
+				}
+			std::copy(t, t + 4, s);
+		}
+		std::uint64_t s[4];
+};
+
+// Bounded rolls, as units and the adaptee use them
+class Roller {
+	public:
+		virtual ~Roller() {}
+		// uniform in 1..sides
+		virtual int roll(int sides) = 0;
+		// one roll per element
+		virtual void roll(std::span<int> out, int sides) = 0;
+		// out[i] uniform in 1..sides[i]
+		virtual void roll(std::span<int> out, std::span<const int> sides) = 0;
+		// out[i] += a roll of 1..sides
+		virtual void add(std::span<int> out, int sides) = 0;
+};
+
+// Combat rolls: Lanes independent xoshiro256** lanes stepped together
+class Dice final : public Roller {
+	public:
+		static const int Lanes = 8;
+		static const int Block = 2 * Lanes;   // 32-bit candidates per step
+
+		// lane i is the generator jumped i times
+		explicit Dice(Xoshiro256 gen) : used(Block) {
+			for (int i = 0; i < Lanes; i++, gen.jump()) {
+				const std::uint64_t* st = gen.state();
+				s0[i] = st[0]; s1[i] = st[1]; s2[i] = st[2]; s3[i] = st[3];
+			}
+		}
+		explicit Dice(std::uint64_t seed) : Dice(Xoshiro256(seed)) {}
+
+		// count non-overlapping streams of one seed, 2^192 steps apart
+		static std::vector<Dice> streams(std::uint64_t seed, std::size_t count) {
+			std::vector<Dice> result;
+			result.reserve(count);
+			Xoshiro256 gen(seed);
+			for (std::size_t i = 0; i < count; i++, gen.longJump())
+				result.emplace_back(gen);
+			return result;
+		}
+		// the calling thread's dice; reseed or replace it by assignment
+		static Dice& local() {
+			static std::atomic<std::uint64_t> threads{0};
+			thread_local Dice dice(0x5eed + threads++);
+			return dice;
+		}
+
+		// uniform in 1..sides
+		int roll(int sides) override {
+			const std::uint32_t threshold = (0u - std::uint32_t(sides)) % std::uint32_t(sides);
+			for (;;) {
+				if (used == Block) { step(buffer); used = 0; }
+				std::uint64_t m = std::uint64_t(buffer[used++]) * std::uint32_t(sides);
+				if (std::uint32_t(m) >= threshold)
+					return int(m >> 32) + 1;
+			}
+		}
+		// one roll per element, Block at a time
+		void roll(std::span<int> out, int sides) override {
+			const std::uint32_t threshold = (0u - std::uint32_t(sides)) % std::uint32_t(sides);
+			std::size_t i = 0;
+			for (; i + Block <= out.size(); i += Block) {
+				std::uint32_t x[Block];
+				step(x);
+				bool biased = false;
+				for (int j = 0; j < Block; j++) {
+					std::uint64_t m = std::uint64_t(x[j]) * std::uint32_t(sides);
+					out[i + j] = int(m >> 32) + 1;
+					biased |= std::uint32_t(m) < threshold;
+				}
+				if (biased)
+					for (int j = 0; j < Block; j++)
+						if (std::uint32_t(std::uint64_t(x[j]) * std::uint32_t(sides)) < threshold)
+							out[i + j] = roll(sides);
+			}
+			for (; i < out.size(); i++)
+				out[i] = roll(sides);
+		}
+		// out[i] uniform in 1..sides[i]; the exact bias check only runs when
+		// the low word is below sides[i] (Lemire)
+		void roll(std::span<int> out, std::span<const int> sides) override {
+			std::size_t i = 0;
+			for (; i + Block <= out.size(); i += Block) {
+				std::uint32_t x[Block];
+				step(x);
+				bool suspect = false;
+				for (int j = 0; j < Block; j++) {
+					std::uint64_t m = std::uint64_t(x[j]) * std::uint32_t(sides[i + j]);
+					out[i + j] = int(m >> 32) + 1;
+					suspect |= std::uint32_t(m) < std::uint32_t(sides[i + j]);
+				}
+				if (suspect)
+					for (int j = 0; j < Block; j++) {
+						std::uint32_t n = sides[i + j];
+						if (std::uint32_t(std::uint64_t(x[j]) * n) < (0u - n) % n)
+							out[i + j] = roll(int(n));
+					}
+			}
+			for (; i < out.size(); i++)
+				out[i] = roll(sides[i]);
+		}
+		// out[i] += a roll of 1..sides
+		void add(std::span<int> out, int sides) override {
+			int rolls[256];
+			for (std::size_t i = 0; i < out.size(); i += 256) {
+				std::size_t n = std::min<std::size_t>(256, out.size() - i);
+				roll(std::span<int>(rolls, n), sides);
+				for (std::size_t j = 0; j < n; j++)
+					out[i + j] += rolls[j];
+			}
+		}
+	private:
+		void step(std::uint32_t* x) {
+			for (int i = 0; i < Lanes; i++) {
+				std::uint64_t result = Xoshiro256::rotl(s1[i] * 5, 7) * 9;
+				std::uint64_t t = s1[i] << 17;
+				s2[i] ^= s0[i]; s3[i] ^= s1[i]; s1[i] ^= s2[i]; s0[i] ^= s3[i];
+				s2[i] ^= t;
+				s3[i] = Xoshiro256::rotl(s3[i], 45);
+				x[i] = std::uint32_t(result >> 32);
+				x[i + Lanes] = std::uint32_t(result);
+			}
+		}
+		alignas(64) std::uint64_t s0[Lanes], s1[Lanes], s2[Lanes], s3[Lanes];
+		std::uint32_t buffer[Block];
+		int used;
+};
+
+// One unit action; the text is only produced by the log writer
+struct Event {
+	enum Kind : std::uint8_t { TankFires, TankMoves, TankDriver, RobotSmashes, RobotWalks, RobotFixates };
+	Kind kind;
+	std::uint32_t value;    // damage, squares or EventLog::intern() id
+};
+
+// Per-thread single-producer rings drained by one writer thread; there is
+// one log per process, so a thread's ring can be found through a thread_local
+class EventLog {
+	public:
+		static const std::size_t Capacity = 1 << 16;   // events per thread
+
+		EventLog(const EventLog&) = delete;
+		~EventLog() {
+			stopping = true;
+			writer.join();
+			std::fflush(out);
+		}
+		// the log every unit action goes to, writing to stdout
+		static EventLog& instance() {
+			static EventLog log(stdout);
+			return log;
+		}
+
+		void push(Event::Kind kind, std::uint32_t value) {
+			thread_local RingLease lease;
+			Ring* ring = lease.ring;
+			if (ring == nullptr) ring = lease.ring = acquireRing();
+			std::size_t head = ring->head.load(std::memory_order_relaxed);
+			if (head - ring->cachedTail == Capacity)
+				while (head - (ring->cachedTail = ring->tail.load(std::memory_order_acquire)) == Capacity)
+					std::this_thread::yield();
+			ring->events[head % Capacity] = { kind, value };
+			ring->head.store(head + 1, std::memory_order_release);
+		}
+		// id of a name for TankDriver and RobotFixates events
+		std::uint32_t intern(const std::string& name) {
+			std::lock_guard<std::mutex> lock(namesMutex);
+			auto it = std::find(names.begin(), names.end(), name);
+			if (it != names.end()) return it - names.begin();
+			names.push_back(name);
+			return names.size() - 1;
+		}
+		// waits until every event pushed so far is written out
+		void flush() {
+			for (Ring* ring : snapshot()) {
+				std::size_t head = ring->head.load(std::memory_order_acquire);
+				while (ring->tail.load(std::memory_order_acquire) < head)
+					std::this_thread::yield();
+			}
+			std::lock_guard<std::mutex> lock(writeMutex);  // the last batch is written under it
+			std::fflush(out);
+		}
+		// switches the destination; flushes what is pending first
+		void setOutput(std::FILE* file) {
+			flush();
+			std::lock_guard<std::mutex> lock(writeMutex);
+			out = file;
+		}
+		std::uint64_t written() const { return eventsWritten.load(); }
+		std::size_t ringCount() {
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			return rings.size();
+		}
+	private:
+		explicit EventLog(std::FILE* out) : out(out), writer([this] { write(); }) {}
+
+		struct Ring {
+			alignas(64) std::atomic<std::size_t> head{0};
+			std::size_t cachedTail = 0;     // producer's last view of tail
+			alignas(64) std::atomic<std::size_t> tail{0};
+			Event events[Capacity];
+		};
+		// a thread's ring, handed back when the thread exits
+		struct RingLease {
+			Ring* ring = nullptr;
+			~RingLease() { if (ring) instance().releaseRing(ring); }
+		};
+		// a ring released by an exited thread, or a new one. Events still in
+		// a reused ring are written in order before the new owner's, and the
+		// mutex orders the old producer's last push before the new one's first
+		Ring* acquireRing() {
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			if (!idle.empty()) {
+				Ring* ring = idle.back();
+				idle.pop_back();
+				return ring;
+			}
+			rings.push_back(std::make_unique<Ring>());
+			return rings.back().get();
+		}
+		void releaseRing(Ring* ring) {
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			idle.push_back(ring);
+		}
+		std::vector<Ring*> snapshot() {
+			std::lock_guard<std::mutex> lock(ringsMutex);
+			std::vector<Ring*> result;
+			for (const std::unique_ptr<Ring>& ring : rings)
+				result.push_back(ring.get());
+			return result;
+		}
+		// one pass over all rings; false when there was nothing to write
+		bool drain(std::string& batch) {
+			bool any = false;
+			std::lock_guard<std::mutex> lock(writeMutex);
+			for (Ring* ring : snapshot()) {
+				std::size_t tail = ring->tail.load(std::memory_order_relaxed);
+				std::size_t head = ring->head.load(std::memory_order_acquire);
+				for (std::size_t i = tail; i < head; i++)
+					format(ring->events[i % Capacity], batch);
+				if (head != tail) {
+					ring->tail.store(head, std::memory_order_release);
+					eventsWritten += head - tail;
+					any = true;
+				}
+				if (batch.size() >= (1 << 16)) {
+					std::fwrite(batch.data(), 1, batch.size(), out);
+					batch.clear();
+				}
+			}
+			std::fwrite(batch.data(), 1, batch.size(), out);
+			batch.clear();
+			return any;
+		}
+		void write() {
+			std::string batch;
+			while (!stopping.load())
+				if (!drain(batch))
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+			while (drain(batch)) {}
+		}
+		void format(const Event& e, std::string& batch) {
+			char number[16];
+			auto value = [&] { return std::string_view(number, std::to_chars(number, number + sizeof number, e.value).ptr - number); };
+			auto name = [&]() -> std::string {
+				std::lock_guard<std::mutex> lock(namesMutex);
+				return names[e.value];
+			};
+			switch (e.kind) {
+				case Event::TankFires:    batch.append("Enemy Tank Does ").append(value()).append(" Damage\n"); break;
+				case Event::TankMoves:    batch.append("Enemy Tank moves ").append(value()).append(" squares\n"); break;
+				case Event::TankDriver:   batch.append(name()).append(" is driving the tank\n"); break;
+				case Event::RobotSmashes: batch.append("Enemy Robot Causes ").append(value()).append(" Damage Melee hit\n"); break;
+				case Event::RobotWalks:   batch.append("Enemy Robot Walks Forward ").append(value()).append(" squares\n"); break;
+				case Event::RobotFixates: batch.append("Enemy Robot Fixates on ").append(name()).append("\n"); break;
+			}
+		}
+
+		std::FILE* out;
+		std::mutex ringsMutex, writeMutex, namesMutex;
+		std::vector<std::unique_ptr<Ring>> rings;
+		std::vector<Ring*> idle;        // owned by rings, no thread pushing
+		std::vector<std::string> names;
+		std::atomic<std::uint64_t> eventsWritten{0};
+		std::atomic<bool> stopping{false};
+		std::thread writer;     // last: starts after everything above exists
+};
+
+// Rows [first, first + n) of every column of one kind of unit
+struct UnitSlice {
+	std::span<int> position;
+	std::span<const int> damageRange;
+	std::span<int> damage;
+	Roller& dice;
+};
+
 // Target Interface : This is what the client expects to work with.
 // It is the adapters job to make new classes compatible with this one.
 class EnemyAttacker {
 	public:
+		virtual ~EnemyAttacker() {}
 		virtual void fireWeapon() = 0;
 		virtual void driveForward() = 0;
 		virtual void assignDriver(std::string driverName) = 0;
+		// Batch forms: act for damage.size() / movement.size() units of this
+		// kind at once, one result per unit, nothing printed
+		virtual void fireWeapon(std::span<int> damage) = 0;
+		virtual void driveForward(std::span<int> movement) = 0;
+		// Column forms: act for every row of units
+		virtual void fireWeapon(const UnitSlice& units) = 0;
+		virtual void driveForward(const UnitSlice& units) = 0;
 };
 
 // We have to make classes with different methods work with the EnemyAttacker interface
 class EnemyTank : public EnemyAttacker{
 	public:
+		// rolls from dice, or from the calling thread's Dice when null
+		explicit EnemyTank(Roller* dice = nullptr) : dice(dice) {}
 		void fireWeapon() override {
-			int attackDamage = rand() % 10 + 1;
-			std::cout << "Enemy Tank Does " << attackDamage << " Damage\n";
+			int attackDamage = roller().roll(10);
+			EventLog::instance().push(Event::TankFires, attackDamage);
 		}
 		void driveForward() override {
-			int movement = rand() % 5 + 1;
-			std::cout << "Enemy Tank moves " << movement << " squares\n";
+			int movement = roller().roll(5);
+			EventLog::instance().push(Event::TankMoves, movement);
 		}
 		void assignDriver(std::string driverName) override {
-			std::cout << driverName + " is driving the tank\n";
+			EventLog::instance().push(Event::TankDriver, EventLog::instance().intern(driverName));
+		}
+		void fireWeapon(std::span<int> damage) override {
+			roller().roll(damage, 10);
+		}
+		void driveForward(std::span<int> movement) override {
+			roller().roll(movement, 5);
+		}
+		void fireWeapon(const UnitSlice& units) override {
+			units.dice.roll(units.damage, units.damageRange);
 		}
+		void driveForward(const UnitSlice& units) override {
+			units.dice.add(units.position, 5);
+		}
+	private:
+		Roller& roller() { return dice ? *dice : Dice::local(); }
+		Roller* dice;
 };
 // This is the Adaptee. The Adapter redirects method calls to objects that use
 // the EnemyAttacker interface to the equivalent methods defined in EnemyRobot
 class EnemyRobot{
 	public:
+		// rolls from dice, or from the calling thread's Dice when null
+		explicit EnemyRobot(Roller* dice = nullptr) : dice(dice) {}
 		void meleeSmash() {
-			int attackDamage = rand() % 20 + 1;
-			std::cout << "Enemy Robot Causes " << attackDamage << " Damage Melee hit\n";
+			int attackDamage = roller().roll(20);
+			EventLog::instance().push(Event::RobotSmashes, attackDamage);
 		}
 		void walkForward() {
-			int movement = rand() % 5 + 1;
-			std::cout << "Enemy Robot Walks Forward " << movement << " squares\n";
+			int movement = roller().roll(5);
+			EventLog::instance().push(Event::RobotWalks, movement);
 		}
  		void reactToHuman(std::string driverName) {
-			std::cout << "Enemy Robot Fixates on " << driverName << "\n";
+			EventLog::instance().push(Event::RobotFixates, EventLog::instance().intern(driverName));
+		}
+		// bulk forms of the same actions
+		void meleeSmash(std::span<int> damage) {
+			roller().roll(damage, 20);
 		}
+		void walkForward(std::span<int> movement) {
+			roller().roll(movement, 5);
+		}
+		// and over columns, rolling from the given dice
+		void meleeSmash(std::span<const int> damageRange, std::span<int> damage, Roller& dice) const {
+			dice.roll(damage, damageRange);
+		}
+		void walkForward(std::span<int> position, Roller& dice) const {
+			dice.add(position, 5);
+		}
+	private:
+		Roller& roller() { return dice ? *dice : Dice::local(); }
+		Roller* dice;
 };
 // The Adapter must provide an alternative action for the the methods that need
 // to be used because EnemyAttacker was implemented.
@@ -52,13 +488,151 @@ class EnemyRobotAdapter : public EnemyAttacker{
 		EnemyRobot theRobot;
 	public:
 		EnemyRobotAdapter(EnemyRobot newRobot) { theRobot = newRobot; }
-		void fireWeapon() {	theRobot.meleeSmash(); }
-		void driveForward() { theRobot.walkForward(); }
-		void assignDriver(std::string driverName) { theRobot.reactToHuman(driverName); }
+		void fireWeapon() override {	theRobot.meleeSmash(); }
+		void driveForward() override { theRobot.walkForward(); }
+		void assignDriver(std::string driverName) override { theRobot.reactToHuman(driverName); }
+		void fireWeapon(std::span<int> damage) override { theRobot.meleeSmash(damage); }
+		void driveForward(std::span<int> movement) override { theRobot.walkForward(movement); }
+		// column mapping: one adapter serves every robot row
+		void fireWeapon(const UnitSlice& units) override { theRobot.meleeSmash(units.damageRange, units.damage, units.dice); }
+		void driveForward(const UnitSlice& units) override { theRobot.walkForward(units.position, units.dice); }
+};
+
+// Fills out with rolls of one seed on threads threads; chunk k always uses
+// stream k, so the result does not depend on the thread count
+void rollChunks(std::span<int> out, int sides, std::uint64_t seed, unsigned threads) {
+	const std::size_t chunk = 1 << 20;
+	std::size_t chunks = (out.size() + chunk - 1) / chunk;
+	std::vector<Dice> dice = Dice::streams(seed, chunks);
+	std::atomic<std::size_t> next{0};
+	auto work = [&] {
+		for (std::size_t k; (k = next++) < chunks; )
+			dice[k].roll(out.subspan(k * chunk, std::min(chunk, out.size() - k * chunk)), sides);
+	};
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; t++)
+		pool.emplace_back(work);
+	work();
+	for (std::thread& t : pool)
+		t.join();
+}
+
+// Threads kept between ticks; parallelFor(n, job) runs job(0..n-1) on all of them
+class TickPool {
+	public:
+		explicit TickPool(unsigned threads) : start(threads), done(threads) {
+			for (unsigned t = 1; t < threads; t++)
+				workers.emplace_back([this] {
+					for (;;) {
+						start.arrive_and_wait();
+						if (stopping) return;
+						run();
+						done.arrive_and_wait();
+					}
+				});
+		}
+		~TickPool() {
+			stopping = true;
+			start.arrive_and_wait();
+			for (std::thread& t : workers)
+				t.join();
+		}
+		void parallelFor(std::size_t n, const std::function<void(std::size_t)>& f) {
+			job = &f;
+			count = n;
+			next = 0;
+			start.arrive_and_wait();
+			run();
+			done.arrive_and_wait();
+		}
+	private:
+		void run() {
+			for (std::size_t k; (k = next++) < count; )
+				(*job)(k);
+		}
+		std::barrier<> start, done;
+		std::vector<std::thread> workers;
+		const std::function<void(std::size_t)>* job = nullptr;
+		std::size_t count = 0;
+		std::atomic<std::size_t> next{0};
+		bool stopping = false;
+};
+
+// Units of one kind, struct-of-arrays: row i of every column is one unit
+struct UnitColumns {
+	std::vector<int> position;
+	std::vector<int> damageRange;       // a unit does 1..damageRange damage
+	std::vector<int> damage;            // from the last fireWeapon
+	std::vector<std::uint32_t> driver;  // index into UnitStore::drivers
+};
+
+// All units of a battle, one set of columns per kind
+class UnitStore {
+	public:
+		static const std::size_t chunkSize = 16384;
+
+		// behaviour does the column operations for every unit of the kind
+		std::size_t addKind(EnemyAttacker& behaviour) {
+			kinds.push_back({ &behaviour, {} });
+			return kinds.size() - 1;
+		}
+		void spawn(std::size_t kind, std::size_t count, int damageRange, const std::string& driver) {
+			UnitColumns& c = kinds[kind].columns;
+			std::uint32_t id = driverId(driver);
+			c.position.resize(c.position.size() + count, 0);
+			c.damageRange.resize(c.damageRange.size() + count, damageRange);
+			c.damage.resize(c.damage.size() + count, 0);
+			c.driver.resize(c.driver.size() + count, id);
+		}
+		std::uint32_t driverId(const std::string& name) {
+			auto it = std::find(drivers.begin(), drivers.end(), name);
+			if (it != drivers.end()) return it - drivers.begin();
+			drivers.push_back(name);
+			return drivers.size() - 1;
+		}
+		// cuts the kinds into chunks, one dice stream each; call after spawning
+		void seed(std::uint64_t seed) {
+			chunks.clear();
+			for (std::size_t k = 0; k < kinds.size(); k++)
+				for (std::size_t first = 0; first < kinds[k].columns.position.size(); first += chunkSize)
+					chunks.push_back({ k, first, std::min(chunkSize, kinds[k].columns.position.size() - first) });
+			dice = Dice::streams(seed, chunks.size());
+		}
+		// every unit drives forward, then fires
+		void tick(TickPool& pool) {
+			pool.parallelFor(chunks.size(), [this](std::size_t k) {
+				const Chunk& chunk = chunks[k];
+				UnitColumns& c = kinds[chunk.kind].columns;
+				UnitSlice units{ std::span<int>(c.position).subspan(chunk.first, chunk.count),
+				                 std::span<const int>(c.damageRange).subspan(chunk.first, chunk.count),
+				                 std::span<int>(c.damage).subspan(chunk.first, chunk.count),
+				                 dice[k] };
+				kinds[chunk.kind].behaviour->driveForward(units);
+				kinds[chunk.kind].behaviour->fireWeapon(units);
+			});
+		}
+		const UnitColumns& columns(std::size_t kind) const { return kinds[kind].columns; }
+		const std::string& driver(std::uint32_t id) const { return drivers[id]; }
+	private:
+		struct Kind { EnemyAttacker* behaviour; UnitColumns columns; };
+		struct Chunk { std::size_t kind, first, count; };
+		std::vector<Kind> kinds;
+		std::vector<Chunk> chunks;
+		std::vector<Dice> dice;
+		std::vector<std::string> drivers;
+};
+
+// Always rolls the highest face: any Roller can drive the units
+class LoadedDice : public Roller {
+	public:
+		int roll(int sides) override { return sides; }
+		void roll(std::span<int> out, int sides) override { std::fill(out.begin(), out.end(), sides); }
+		void roll(std::span<int> out, std::span<const int> sides) override { std::copy(sides.begin(), sides.end(), out.begin()); }
+		void add(std::span<int> out, int sides) override { for (int& x : out) x += sides; }
 };
 
-int main(){
-	srand(time(0));
+int main(int argc, char* argv[]){
+	Dice::local() = Dice(time(0));
 
 	EnemyTank T80Tank;
 	EnemyRobot RoboCop;
@@ -68,18 +642,164 @@ int main(){
 	RoboCop.reactToHuman("Alex");
 	RoboCop.walkForward();
 	RoboCop.meleeSmash();
+	EventLog::instance().flush();
 	std::cout << std::endl;
 
 	std::cout << "The Enemy Tank:" << std::endl;
 	T80Tank.assignDriver("Kim Jong-un");
 	T80Tank.driveForward();
 	T80Tank.fireWeapon();
+	EventLog::instance().flush();
 	std::cout << std::endl;
 
 	std::cout << "The Robot with Adapter" << std::endl;
 	robotAdapter->assignDriver("C-3PO");
 	robotAdapter->driveForward();
 	robotAdapter->fireWeapon();
+	EventLog::instance().flush();
+	std::cout << std::endl;
+
+	std::cout << "The Robot with Adapter and loaded dice" << std::endl;
+	LoadedDice loaded;
+	EnemyRobotAdapter loadedRobot{ EnemyRobot(&loaded) };
+	loadedRobot.driveForward();
+	loadedRobot.fireWeapon();
+	EventLog::instance().flush();
+	std::cout << std::endl;
+
+	// One tick for 10^6 units, half tanks and half robots
+	const std::size_t units = 1000000;
+	std::vector<EnemyAttacker*> army;
+	for (std::size_t i = 0; i < units; i++)
+		army.push_back(i % 2 ? robotAdapter : static_cast<EnemyAttacker*>(&T80Tank));
+
+	std::FILE* devNull = std::fopen("/dev/null", "w");
+	EventLog::instance().setOutput(devNull);
+	auto t0 = std::chrono::steady_clock::now();
+	for (EnemyAttacker* unit : army) {
+		unit->driveForward();
+		unit->fireWeapon();
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	EventLog::instance().setOutput(stdout);
+	std::fclose(devNull);
+
+	std::vector<int> movement(units), damage(units);
+	std::span<int> tankMoves(movement.data(), units / 2), robotMoves(movement.data() + units / 2, units / 2);
+	std::span<int> tankDamage(damage.data(), units / 2), robotDamage(damage.data() + units / 2, units / 2);
+	auto t2 = std::chrono::steady_clock::now();
+	T80Tank.driveForward(tankMoves);
+	T80Tank.fireWeapon(tankDamage);
+	robotAdapter->driveForward(robotMoves);
+	robotAdapter->fireWeapon(robotDamage);
+	auto t3 = std::chrono::steady_clock::now();
+
+	std::chrono::duration<double> perUnit = t1 - t0, batch = t3 - t2;
+	std::cout << "per-unit dispatch: " << units / perUnit.count() / 1e6 << " M units/s\n";
+	std::cout << "batch dispatch:    " << units / batch.count() / 1e6 << " M units/s\n";
+
+	std::cout << std::endl;
+
+	// Rolls per second: rand(), one Dice roll at a time, bulk, and chunked
+	// across threads (same checksum for every thread count)
+	const std::size_t rolls = 1 << 26;
+	std::vector<int> out(rolls);
+	auto rate = [&](const char* name, auto fill) {
+		auto start = std::chrono::steady_clock::now();
+		fill();
+		std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+		std::uint64_t sum = 0;
+		for (std::size_t i = 0; i < rolls; i++)
+			sum = sum * 31 + out[i];
+		std::cout << name << rolls / sec.count() / 1e6 << " M rolls/s, checksum " << sum << "\n";
+	};
+	rate("rand() % 20 + 1:      ", [&] { for (int& r : out) r = rand() % 20 + 1; });
+	rate("Dice::roll(20):       ", [&] { Dice dice(42); for (int& r : out) r = dice.roll(20); });
+	rate("Dice::roll(span, 20): ", [&] { Dice(42).roll(out, 20); });
+	for (unsigned threads : { 1u, 3u, 8u }) {
+		std::string name = "chunked, " + std::to_string(threads) + " thread(s): ";
+		name.resize(22, ' ');
+		rate(name.c_str(), [&] { rollChunks(out, 20, 42, threads); });
+	}
+
+	std::cout << std::endl;
+
+	// Ticks per second of a half tank, half robot battle, 10^5 units up to
+	// argv[1] (default 10^7), each size on 1..N threads
+	std::size_t maxUnits = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+	unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+	for (std::size_t n = 100000; n <= maxUnits; n *= 10) {
+		UnitStore battle;
+		std::size_t tanks = battle.addKind(T80Tank);
+		std::size_t robots = battle.addKind(*robotAdapter);
+		battle.spawn(tanks, n / 2, 10, "Kim Jong-un");
+		battle.spawn(robots, n - n / 2, 20, "C-3PO");
+		int ticks = int(std::max<std::size_t>(3, 200000000 / n / 10));
+		double base = 0;
+		for (unsigned threads = 1; ; threads = std::min(hw, threads * 2)) {
+			TickPool pool(threads);
+			battle.seed(42);
+			auto start = std::chrono::steady_clock::now();
+			for (int t = 0; t < ticks; t++)
+				battle.tick(pool);
+			std::chrono::duration<double> sec = std::chrono::steady_clock::now() - start;
+			if (threads == 1) base = sec.count();
+			const UnitColumns& r = battle.columns(robots);
+			std::cout << n << " units, " << threads << " thread(s): " << ticks / sec.count() << " ticks/s, "
+			          << n * ticks / sec.count() / 1e6 << " M unit-ticks/s, speedup " << base / sec.count()
+			          << "x (" << battle.driver(r.driver.back()) << "'s robot at " << r.position.back() << ")\n";
+			if (threads == hw) break;
+		}
+	}
+
+	std::cout << std::endl;
+
+	// The same 4M actions formatted straight into std::cout and through the
+	// event log, both going to a file
+	const std::size_t events = 4000000;
+	std::string directPath = std::filesystem::temp_directory_path() / "adapter2_cout.log";
+	std::string logPath = std::filesystem::temp_directory_path() / "adapter2_events.log";
+	std::ofstream directFile(directPath);
+	std::streambuf* console = std::cout.rdbuf(directFile.rdbuf());
+	auto d0 = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < events; i++)
+		if (i % 2) std::cout << "Enemy Tank Does " << Dice::local().roll(10) << " Damage\n";
+		else       std::cout << "Enemy Robot Walks Forward " << Dice::local().roll(5) << " squares\n";
+	std::cout.flush();
+	auto d1 = std::chrono::steady_clock::now();
+	std::cout.rdbuf(console);
+
+	std::FILE* logFile = std::fopen(logPath.c_str(), "w");
+	EventLog::instance().setOutput(logFile);
+	std::uint64_t before = EventLog::instance().written();
+	auto l0 = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < events; i++)
+		if (i % 2) T80Tank.fireWeapon();
+		else       RoboCop.walkForward();
+	auto l1 = std::chrono::steady_clock::now();
+	EventLog::instance().flush();
+	auto l2 = std::chrono::steady_clock::now();
+	std::uint64_t logged = EventLog::instance().written() - before;
+	EventLog::instance().setOutput(stdout);
+	std::fclose(logFile);
+	std::filesystem::remove(directPath);
+	std::filesystem::remove(logPath);
+
+	std::chrono::duration<double, std::nano> direct = d1 - d0, pushed = l1 - l0, written = l2 - l0;
+	std::cout << "direct cout: " << direct.count() / events << " ns/event\n";
+	std::cout << "event log:   " << pushed.count() / events << " ns/event on the caller, "
+	          << written.count() / events << " ns/event until written, "
+	          << logged << " of " << events << " events written\n";
+
+	// threads that come and go take over the rings of those that exited
+	std::FILE* sink = std::fopen("/dev/null", "w");
+	EventLog::instance().setOutput(sink);
+	for (int i = 0; i < 1000; i++)
+		std::thread([&T80Tank] { T80Tank.fireWeapon(); }).join();
+	EventLog::instance().setOutput(stdout);
+	std::fclose(sink);
+	std::cout << "1000 short-lived threads: " << EventLog::instance().ringCount() << " rings allocated\n";
 
+	delete robotAdapter;
 	return EXIT_SUCCESS;
 }
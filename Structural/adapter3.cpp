@@ -0,0 +1,173 @@
+/*
+ Static (compile-time) adapters.
+
+ The adapters in adapter0.cpp and adapter1.cpp are runtime-polymorphic: a
+ class or object adapter adds a virtual call plus a forwarding call, and an
+ adapter over an AdapteeInterface adds a second virtual call. When adapters
+ wrap adapters on a hot path those calls add up.
+
+ Here the Target interface is a concept instead of a base class, and
+ StaticAdapter<Adaptee, &Adaptee::member> maps a member function of the
+ Adaptee onto Target::operation() at compile time. Clients are templates
+ constrained by the concept, so every call - through any number of stacked
+ static adapters - inlines down to the adaptee's code. When a runtime
+ interface is still needed, DynamicTarget<T> wraps any static Target in the
+ classic virtual TargetInterface.
+*/
+#include <iostream>
+#include <concepts>
+#include <chrono>
+#include <cstdlib>
+
+// Desired interface (Target), compile-time version
+template <class T>
+concept Target = requires(T t) { t.operation(); };
+
+// Desired interface (Target), runtime version
+class TargetInterface
+{
+    public:
+        virtual ~TargetInterface() {}
+        virtual void operation() = 0;
+};
+
+/* Adaptee (source) interface, for the double-virtual adapter */
+class AdapteeInterface
+{
+    public:
+        virtual ~AdapteeInterface() {}
+        virtual void specificOperation() = 0;
+};
+
+/* One add per call that the optimizer can neither fold across a loop nor
+   drop: the asm claims to read and rewrite the counter. Every adaptee below
+   does exactly this, so the rows differ only in how the call reaches it. */
+inline void work(long& calls)
+{
+    calls++;
+#if defined(__GNUC__)
+    asm volatile("" : "+r"(calls));
+#else
+    *static_cast<volatile long*>(&calls) = calls;
+#endif
+}
+
+// Legacy component (Adaptee); counts its calls instead of printing them
+class Adaptee
+{
+    public:
+        void specificOperation() { work(m_calls); }
+        long calls() const { return m_calls; }
+    private:
+        long m_calls = 0;
+};
+
+// Legacy component behind the adaptee interface (as in adapter1.cpp)
+class VirtualAdaptee : public AdapteeInterface
+{
+    public:
+        void specificOperation() override { work(m_calls); }
+        long calls() const { return m_calls; }
+    private:
+        long m_calls = 0;
+};
+
+// Class Adapter (implements Target, inherits Adaptee)
+class classAdapter : public TargetInterface, private Adaptee
+{
+    public:
+        void operation() override { specificOperation(); }
+        long calls() const { return Adaptee::calls(); }
+};
+
+// Object Adapter (implements Target, associates Adaptee)
+class objectAdapter : public TargetInterface
+{
+    public:
+        objectAdapter(Adaptee& ad) : m_adaptee(ad) {}
+        void operation() override { m_adaptee.specificOperation(); }
+    private:
+        Adaptee& m_adaptee;
+};
+
+// Object Adapter over the adaptee interface: two virtual calls per operation
+class interfaceAdapter : public TargetInterface
+{
+    public:
+        interfaceAdapter(AdapteeInterface& ad) : m_adaptee(ad) {}
+        void operation() override { m_adaptee.specificOperation(); }
+    private:
+        AdapteeInterface& m_adaptee;
+};
+
+// Static Adapter: Method of A becomes operation(), resolved at compile time
+template <class A, void (A::*Method)()>
+class StaticAdapter
+{
+    public:
+        StaticAdapter(A& ad) : m_adaptee(ad) {}
+        void operation() { (m_adaptee.*Method)(); }
+    private:
+        A& m_adaptee;
+};
+
+// Any static Target behind the runtime interface
+template <Target T>
+class DynamicTarget : public TargetInterface
+{
+    public:
+        DynamicTarget(T target) : m_target(target) {}
+        void operation() override { m_target.operation(); }
+    private:
+        T m_target;
+};
+
+// Clients: one generic over the concept, one over the runtime interface
+template <Target T>
+void useTarget(T& target, long n)
+{
+    for (long i = 0; i < n; i++)
+        target.operation();
+}
+
+__attribute__((noinline)) void useTargetInterface(TargetInterface& target, long n)
+{
+    for (long i = 0; i < n; i++)
+        target.operation();
+}
+
+// Runs f and prints ns per operation
+template <class F>
+void measure(const char* name, long n, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << elapsed.count() / n << " ns/call\n";
+}
+
+int main()
+{
+    const long n = 200000000;
+    Adaptee ad;
+    VirtualAdaptee vad;
+
+    classAdapter ca;
+    objectAdapter oa(ad);
+    interfaceAdapter ia(vad);
+    typedef StaticAdapter<Adaptee, &Adaptee::specificOperation> AdapteeTarget;
+    AdapteeTarget sa(ad);
+    // an adapter wrapping an adapter still inlines
+    StaticAdapter<AdapteeTarget, &AdapteeTarget::operation> ssa(sa);
+    DynamicTarget<AdapteeTarget> da(sa);
+
+    measure("class adapter (virtual):                ", n, [&] { useTargetInterface(ca, n); });
+    measure("object adapter (virtual):               ", n, [&] { useTargetInterface(oa, n); });
+    measure("adapter over interface (2 virtual):     ", n, [&] { useTargetInterface(ia, n); });
+    measure("static adapter:                         ", n, [&] { useTarget(sa, n); });
+    measure("static adapter of static adapter:       ", n, [&] { useTarget(ssa, n); });
+    measure("static adapter behind TargetInterface:  ", n, [&] { useTargetInterface(da, n); });
+
+    std::cout << "adaptee calls: " << ca.calls() + ad.calls() + vad.calls() << std::endl;
+    return EXIT_SUCCESS;
+}
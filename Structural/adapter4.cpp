@@ -0,0 +1,282 @@
+/*
+ Asynchronous adapter.
+
+ In adapter0.cpp and adapter1.cpp Adaptee::specificOperation() is
+ synchronous, and so is the Target interface: when the legacy adaptee blocks
+ for milliseconds, so does every caller, and one thread can only have one
+ operation in flight.
+
+ AsyncAdapter adapts the blocking Adaptee to AsyncTargetInterface, whose
+ operation() returns an awaitable Operation. Awaiting it hands the blocking
+ call to a BoundedExecutor (a fixed pool of threads with a cap on queued plus
+ running calls) and suspends the coroutine. When the call returns, the
+ coroutine is posted back to the caller's EventLoop and resumed there, so the
+ coroutines themselves run on one thread and need no locking. Once the cap
+ is reached, submitting blocks the caller until a call finishes: that is the
+ backpressure. One caller thread can then keep thousands of adaptee
+ operations in flight.
+*/
+#include <iostream>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+typedef std::chrono::steady_clock Clock;
+
+// Desired interface (Target), synchronous as in adapter0.cpp
+class TargetInterface
+{
+    public:
+        virtual ~TargetInterface() {}
+        virtual void operation() = 0;
+};
+
+// Legacy component (Adaptee): every call blocks for `delay`
+class Adaptee
+{
+    public:
+        explicit Adaptee(std::chrono::microseconds delay) : m_delay(delay) {}
+        void specificOperation()
+        {
+            std::this_thread::sleep_for(m_delay);
+            m_calls++;
+        }
+        long calls() const { return m_calls; }
+    private:
+        std::chrono::microseconds m_delay;
+        std::atomic<long> m_calls{0};
+};
+
+// Object Adapter (implements Target, associates Adaptee)
+class objectAdapter : public TargetInterface
+{
+    public:
+        objectAdapter(Adaptee& ad) : m_adaptee(ad) {}
+        void operation() override { m_adaptee.specificOperation(); }
+    private:
+        Adaptee& m_adaptee;
+};
+
+/* Coroutines waiting to be resumed on the thread that calls run() */
+class EventLoop
+{
+    public:
+        void post(std::coroutine_handle<> h)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            ready.push_back(h);
+            cv.notify_one();
+        }
+        /* resumes posted coroutines until done() is true */
+        void run(const std::function<bool()>& done)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            while (!done())
+            {
+                cv.wait(lock, [this] { return !ready.empty(); });
+                std::deque<std::coroutine_handle<>> batch;
+                batch.swap(ready);
+                lock.unlock();
+                for (std::coroutine_handle<> h : batch)
+                    h.resume();
+                lock.lock();
+            }
+        }
+    private:
+        std::mutex m;
+        std::condition_variable cv;
+        std::deque<std::coroutine_handle<>> ready;
+};
+
+/* Runs blocking calls on `threads` threads, at most `capacity` queued or running */
+class BoundedExecutor
+{
+    public:
+        struct Job
+        {
+            std::function<void()> call;
+            std::coroutine_handle<> waiter;
+            std::exception_ptr* error;
+            EventLoop* loop;
+        };
+
+        BoundedExecutor(unsigned threads, std::size_t capacity) : capacity(capacity)
+        {
+            for (unsigned t = 0; t < threads; t++)
+                workers.emplace_back([this] { work(); });
+        }
+        ~BoundedExecutor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            notEmpty.notify_all();
+            for (std::thread& t : workers)
+                t.join();
+        }
+        /* blocks while the executor is full */
+        void submit(Job job)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            notFull.wait(lock, [this] { return inFlight < capacity; });
+            inFlight++;
+            jobs.push_back(std::move(job));
+            notEmpty.notify_one();
+        }
+    private:
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(m);
+            for (;;)
+            {
+                notEmpty.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                Job job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                try { job.call(); }
+                catch (...) { *job.error = std::current_exception(); }
+                lock.lock();
+                inFlight--;
+                notFull.notify_one();
+                job.loop->post(job.waiter);
+            }
+        }
+
+        std::size_t capacity;
+        std::size_t inFlight = 0;
+        bool stopping = false;
+        std::mutex m;
+        std::condition_variable notEmpty, notFull;
+        std::deque<Job> jobs;
+        std::vector<std::thread> workers;
+};
+
+/* Awaitable for one call on an executor; rethrows what the call threw */
+class Operation
+{
+    public:
+        Operation(BoundedExecutor& executor, EventLoop& loop, std::function<void()> call)
+            : executor(executor), loop(loop), call(std::move(call)) {}
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            executor.submit({ std::move(call), h, &error, &loop });
+        }
+        void await_resume()
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    private:
+        BoundedExecutor& executor;
+        EventLoop& loop;
+        std::function<void()> call;
+        std::exception_ptr error;
+};
+
+// Desired interface (Target), asynchronous
+class AsyncTargetInterface
+{
+    public:
+        virtual ~AsyncTargetInterface() {}
+        virtual Operation operation() = 0;
+};
+
+// Async Adapter (implements the async Target, runs the Adaptee on an executor)
+class AsyncAdapter : public AsyncTargetInterface
+{
+    public:
+        AsyncAdapter(Adaptee& ad, BoundedExecutor& executor, EventLoop& loop)
+            : m_adaptee(ad), m_executor(executor), m_loop(loop) {}
+        Operation operation() override
+        {
+            return Operation(m_executor, m_loop, [this] { m_adaptee.specificOperation(); });
+        }
+    private:
+        Adaptee& m_adaptee;
+        BoundedExecutor& m_executor;
+        EventLoop& m_loop;
+};
+
+/* Coroutine that starts at once and is not awaited by anyone */
+struct Detached
+{
+    struct promise_type
+    {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/* Client: n operations one after the other, recording each latency in us */
+Detached useTarget(AsyncTargetInterface& target, int n, std::vector<double>& latencies, int& running)
+{
+    for (int i = 0; i < n; i++)
+    {
+        Clock::time_point start = Clock::now();
+        co_await target.operation();
+        latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    running--;
+}
+
+void report(const char* name, std::vector<double>& latencies, double seconds)
+{
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << latencies.size() / seconds << " ops/s, latency p50 "
+              << latencies[latencies.size() / 2] / 1000 << " ms, p99 "
+              << latencies[latencies.size() * 99 / 100] / 1000 << " ms\n";
+}
+
+int main()
+{
+    Adaptee ad(std::chrono::milliseconds(2));
+
+    /* synchronous: one operation at a time */
+    objectAdapter sync(ad);
+    std::vector<double> syncLatencies;
+    Clock::time_point s0 = Clock::now();
+    for (int i = 0; i < 200; i++)
+    {
+        Clock::time_point start = Clock::now();
+        sync.operation();
+        syncLatencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    double syncSeconds = std::chrono::duration<double>(Clock::now() - s0).count();
+
+    /* asynchronous: 4000 client coroutines on this thread, 10 operations
+       each, 512 executor threads and at most 2048 calls in flight */
+    EventLoop loop;
+    std::vector<double> asyncLatencies;
+    double asyncSeconds;
+    {
+        BoundedExecutor executor(512, 2048);
+        AsyncAdapter async(ad, executor, loop);
+        int running = 4000;
+        Clock::time_point a0 = Clock::now();
+        for (int c = 0, clients = running; c < clients; c++)
+            useTarget(async, 10, asyncLatencies, running);
+        loop.run([&] { return running == 0; });
+        asyncSeconds = std::chrono::duration<double>(Clock::now() - a0).count();
+    }
+
+    report("synchronous adapter: ", syncLatencies, syncSeconds);
+    report("async adapter:       ", asyncLatencies, asyncSeconds);
+    std::cout << "adaptee calls: " << ad.calls() << std::endl;
+    return EXIT_SUCCESS;
+}
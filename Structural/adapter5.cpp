@@ -0,0 +1,433 @@
+/*
+ Out-of-process adapter.
+
+ The EnemyRobotAdapter in adapter2.cpp holds the adaptee in-process. Here
+ the EnemyRobot runs in a child process for isolation, and RemoteRobotAdapter
+ forwards EnemyAttacker calls to it as fixed-size Call records. The calls go
+ over a Channel: ShmChannel uses two single-producer/single-consumer rings in
+ POSIX shared memory, where a side that finds its ring empty (or full) spins
+ briefly and then sleeps on a futex that the other side wakes. The sleep has
+ a timeout, after which the side checks that the other process still exists
+ and throws if it does not, as PipeChannel does on end of file. PipeChannel
+ sends the same records over two pipes and is the baseline.
+
+ A per-unit call is one round trip. The batch forms send a whole span of
+ calls with one publish and one wakeup, then collect the results, so the
+ per-call cost of the channel is shared by the batch.
+*/
+#include <iostream>
+#include <string>
+#include <span>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Target Interface : This is what the client expects to work with.
+class EnemyAttacker {
+	public:
+		virtual ~EnemyAttacker() {}
+		virtual void fireWeapon() = 0;
+		virtual void driveForward() = 0;
+		virtual void assignDriver(std::string driverName) = 0;
+		// Batch forms: act for damage.size() / movement.size() units at once
+		virtual void fireWeapon(std::span<int> damage) = 0;
+		virtual void driveForward(std::span<int> movement) = 0;
+};
+
+// The Adaptee; lives in the child process and returns what it did
+class EnemyRobot{
+	public:
+		int meleeSmash() { return std::uniform_int_distribution<int>(1, 20)(gen); }
+		int walkForward() { return std::uniform_int_distribution<int>(1, 5)(gen); }
+		int reactToHuman(const std::string& driverName) { fixatedOn = driverName; return 0; }
+	private:
+		std::mt19937 gen{std::random_device{}()};
+		std::string fixatedOn;
+};
+
+// One call to the robot, and its answer in result
+struct Call {
+	enum Op : std::uint32_t { Smash, Walk, React, Quit };
+	Op op;
+	std::int32_t result;
+	char name[56];      // React only
+};
+
+// Both directions of a call stream; send and receive block
+class Channel {
+	public:
+		virtual ~Channel() {}
+		virtual void send(const Call* calls, std::size_t n) = 0;
+		// at least one and at most max calls
+		virtual std::size_t receive(Call* calls, std::size_t max) = 0;
+};
+
+static long futex(std::atomic<std::uint32_t>& word, int op, std::uint32_t value, const timespec* timeout = nullptr) {
+	return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+// hint to the core that this is a spin-wait loop
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// Single-producer single-consumer ring, placed in memory shared by two processes.
+// push and pop call stalled() each time a wait times out; it may throw.
+struct Ring {
+	static constexpr std::uint32_t Capacity = 1024;
+	static constexpr timespec Timeout = { 0, 100 * 1000 * 1000 };
+
+	alignas(64) std::atomic<std::uint32_t> head;   // next slot the producer writes
+	std::atomic<std::uint32_t> consumerSleeping;
+	alignas(64) std::atomic<std::uint32_t> tail;   // next slot the consumer reads
+	std::atomic<std::uint32_t> producerSleeping;
+	alignas(64) Call slots[Capacity];
+
+	template <class Stalled>
+	void push(const Call* calls, std::size_t n, Stalled stalled) {
+		std::uint32_t h = head.load(std::memory_order_relaxed);
+		while (n > 0) {
+			std::uint32_t room = Capacity - (h - tail.load(std::memory_order_acquire));
+			if (room == 0) {
+				if (!wait(tail, producerSleeping, [&] { return h - tail.load() != Capacity; }))
+					stalled();
+				continue;
+			}
+			std::uint32_t k = std::min<std::size_t>(room, n);
+			for (std::uint32_t i = 0; i < k; i++)
+				slots[(h + i) % Capacity] = calls[i];
+			h += k;
+			calls += k;
+			n -= k;
+			head.store(h, std::memory_order_seq_cst);
+			wake(head, consumerSleeping);
+		}
+	}
+	template <class Stalled>
+	std::size_t pop(Call* calls, std::size_t max, Stalled stalled) {
+		std::uint32_t t = tail.load(std::memory_order_relaxed);
+		std::uint32_t h;
+		while ((h = head.load(std::memory_order_acquire)) == t)
+			if (!wait(head, consumerSleeping, [&] { return head.load() != t; }))
+				stalled();
+		std::uint32_t k = std::min<std::size_t>(h - t, max);
+		for (std::uint32_t i = 0; i < k; i++)
+			calls[i] = slots[(t + i) % Capacity];
+		tail.store(t + k, std::memory_order_seq_cst);
+		wake(tail, producerSleeping);
+		return k;
+	}
+	// spins, then announces itself in sleeping and sleeps on word until ready()
+	// or woken; false when the sleep ran into Timeout
+	template <class Ready>
+	static bool wait(std::atomic<std::uint32_t>& word, std::atomic<std::uint32_t>& sleeping, Ready ready) {
+		// spinning only helps when the other process runs on another core
+		static const int spins = std::thread::hardware_concurrency() > 1 ? 2000 : 0;
+		for (int i = 0; i < spins; i++) {
+			if (ready()) return true;
+			cpuRelax();
+		}
+		std::uint32_t seen = word.load();
+		sleeping.store(1, std::memory_order_seq_cst);
+		bool timedOut = !ready() && futex(word, FUTEX_WAIT, seen, &Timeout) != 0 && errno == ETIMEDOUT;
+		sleeping.store(0, std::memory_order_relaxed);
+		return !timedOut;
+	}
+	static void wake(std::atomic<std::uint32_t>& word, std::atomic<std::uint32_t>& sleeping) {
+		if (sleeping.load(std::memory_order_seq_cst))
+			futex(word, FUTEX_WAKE, 1);
+	}
+};
+
+// The two rings of a shm_open() region, mapped before fork()
+class SharedRings {
+	public:
+		SharedRings() {
+			std::string name = "/adapter5-" + std::to_string(getpid());
+			int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd < 0) throw std::runtime_error("shm_open failed");
+			shm_unlink(name.c_str());   // the mapping keeps it alive
+			if (ftruncate(fd, sizeof(Ring) * 2) != 0) throw std::runtime_error("ftruncate failed");
+			void* p = mmap(nullptr, sizeof(Ring) * 2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (p == MAP_FAILED) throw std::runtime_error("mmap failed");
+			rings = static_cast<Ring*>(p);   // zero filled: empty rings, nobody sleeping
+		}
+		~SharedRings() { munmap(rings, sizeof(Ring) * 2); }
+		Ring& requests() { return rings[0]; }
+		Ring& responses() { return rings[1]; }
+	private:
+		Ring* rings;
+};
+
+// peer is the process at the other end: our child or our parent
+class ShmChannel : public Channel {
+	public:
+		ShmChannel(Ring& out, Ring& in, pid_t peer) : out(out), in(in), peer(peer) {}
+		void send(const Call* calls, std::size_t n) override {
+			out.push(calls, n, [this] { checkPeer(); });
+		}
+		std::size_t receive(Call* calls, std::size_t max) override {
+			return in.pop(calls, max, [this] { checkPeer(); });
+		}
+	private:
+		// throws once the peer has exited; a dead child is reaped here
+		void checkPeer() {
+			pid_t r = waitpid(peer, nullptr, WNOHANG);
+			bool alive = r == 0 || (r < 0 && errno == ECHILD && getppid() == peer);
+			if (!alive)
+				throw std::runtime_error("shared memory peer exited");
+		}
+		Ring& out;
+		Ring& in;
+		pid_t peer;
+};
+
+class PipeChannel : public Channel {
+	public:
+		PipeChannel(int out, int in) : out(out), in(in) {}
+		void send(const Call* calls, std::size_t n) override {
+			const char* p = reinterpret_cast<const char*>(calls);
+			for (std::size_t left = n * sizeof(Call); left > 0; ) {
+				ssize_t w = write(out, p, left);
+				if (w <= 0) throw std::runtime_error("pipe write failed");
+				p += w;
+				left -= w;
+			}
+		}
+		std::size_t receive(Call* calls, std::size_t max) override {
+			char* p = reinterpret_cast<char*>(calls);
+			std::size_t got = 0;
+			// at least one whole call, and never half of one
+			while (got < sizeof(Call) || got % sizeof(Call) != 0) {
+				ssize_t r = read(in, p + got, max * sizeof(Call) - got);
+				if (r <= 0) throw std::runtime_error("pipe read failed");
+				got += r;
+			}
+			return got / sizeof(Call);
+		}
+	private:
+		int out, in;
+};
+
+// Child process main: answers calls until Quit
+void serveRobot(Channel& channel) {
+	EnemyRobot robot;
+	std::vector<Call> calls(Ring::Capacity);
+	for (;;) {
+		std::size_t n = channel.receive(calls.data(), calls.size());
+		for (std::size_t i = 0; i < n; i++) {
+			Call& c = calls[i];
+			switch (c.op) {
+				case Call::Smash: c.result = robot.meleeSmash(); break;
+				case Call::Walk:  c.result = robot.walkForward(); break;
+				case Call::React: c.result = robot.reactToHuman(c.name); break;
+				case Call::Quit:  channel.send(calls.data(), i + 1); return;
+			}
+		}
+		channel.send(calls.data(), n);
+	}
+}
+
+// The Adapter: EnemyAttacker calls become calls to the robot process
+class RemoteRobotAdapter : public EnemyAttacker{
+	public:
+		static constexpr std::size_t MaxBatch = Ring::Capacity / 2;
+
+		explicit RemoteRobotAdapter(Channel& channel) : channel(channel) {}
+		~RemoteRobotAdapter() {
+			try { call(Call::Quit); }
+			catch (const std::exception&) {}    // the robot is gone already
+		}
+
+		void fireWeapon() override {
+			std::cout << "Enemy Robot Causes " << call(Call::Smash) << " Damage Melee hit\n";
+		}
+		void driveForward() override {
+			std::cout << "Enemy Robot Walks Forward " << call(Call::Walk) << " squares\n";
+		}
+		void assignDriver(std::string driverName) override {
+			call(Call::React, driverName);
+			std::cout << "Enemy Robot Fixates on " << driverName << "\n";
+		}
+		void fireWeapon(std::span<int> damage) override { batch(Call::Smash, damage); }
+		void driveForward(std::span<int> movement) override { batch(Call::Walk, movement); }
+	private:
+		int call(Call::Op op, const std::string& name = std::string()) {
+			Call c{ op, 0, {} };
+			std::strncpy(c.name, name.c_str(), sizeof c.name - 1);
+			channel.send(&c, 1);
+			channel.receive(&c, 1);
+			return c.result;
+		}
+		// MaxBatch calls in flight at most, so neither ring can fill up while
+		// the other side waits on it
+		void batch(Call::Op op, std::span<int> results) {
+			Call calls[MaxBatch];
+			for (std::size_t first = 0; first < results.size(); first += MaxBatch) {
+				std::size_t n = std::min(MaxBatch, results.size() - first);
+				for (std::size_t i = 0; i < n; i++)
+					calls[i] = Call{ op, 0, {} };
+				channel.send(calls, n);
+				for (std::size_t got = 0; got < n; )
+					got += channel.receive(calls + got, n - got);
+				for (std::size_t i = 0; i < n; i++)
+					results[first + i] = calls[i].result;
+			}
+		}
+		Channel& channel;
+};
+
+// Round trips one call at a time, then calls per second in batches
+void measure(const char* name, EnemyAttacker& robot) {
+	typedef std::chrono::steady_clock clock;
+	std::vector<double> latencies;
+	int one;
+	for (int i = 0; i < 20000; i++) {
+		auto start = clock::now();
+		robot.fireWeapon(std::span<int>(&one, 1));
+		latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+	}
+	std::sort(latencies.begin(), latencies.end());
+	std::vector<int> damage(2000000);
+	auto start = clock::now();
+	robot.fireWeapon(damage);
+	double sec = std::chrono::duration<double>(clock::now() - start).count();
+	std::cout << name << "round trip p50 " << latencies[latencies.size() / 2] << " us, p99 "
+	          << latencies[latencies.size() * 99 / 100] << " us; batched " << damage.size() / sec / 1e6
+	          << " M calls/s\n";
+}
+
+// Forks a robot served over two new pipes; out and in are the parent's ends.
+// Each side closes the ends it does not use, so either one sees end of file
+// (or EPIPE) as soon as the other exits. Returns -1 when fork() fails.
+pid_t spawnPipeRobot(int& out, int& in) {
+	int toChild[2], toParent[2];
+	if (pipe(toChild) != 0)
+		return -1;
+	if (pipe(toParent) != 0) {
+		close(toChild[0]);
+		close(toChild[1]);
+		return -1;
+	}
+	pid_t child = fork();
+	if (child == 0) {
+		close(toChild[1]);
+		close(toParent[0]);
+		PipeChannel channel(toParent[1], toChild[0]);
+		try { serveRobot(channel); }
+		catch (const std::exception&) { _exit(1); }
+		_exit(0);
+	}
+	close(toChild[0]);
+	close(toParent[1]);
+	if (child < 0) {
+		close(toChild[1]);
+		close(toParent[0]);
+		return -1;
+	}
+	out = toChild[1];
+	in = toParent[0];
+	return child;
+}
+
+// A pipe robot is killed; reading its answer must throw, not block
+bool deadPipeRobotThrows() {
+	int out, in;
+	pid_t child = spawnPipeRobot(out, in);
+	if (child < 0)
+		return false;
+	PipeChannel channel(out, in);
+	kill(child, SIGKILL);
+	waitpid(child, nullptr, 0);
+	bool threw = false;
+	alarm(5);   // a blocked read ends the process instead of hanging it
+	try {
+		Call c;
+		channel.receive(&c, 1);
+	}
+	catch (const std::runtime_error&) { threw = true; }
+	alarm(0);
+	close(out);
+	close(in);
+	return threw;
+}
+
+int main(){
+	SharedRings rings;
+	// a write to a dead robot's pipe fails with EPIPE instead of killing us
+	std::signal(SIGPIPE, SIG_IGN);
+
+	pid_t parent = getpid();
+	pid_t shmChild = fork();
+	if (shmChild < 0) {
+		std::perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (shmChild == 0) {
+		ShmChannel channel(rings.responses(), rings.requests(), parent);
+		try { serveRobot(channel); }
+		catch (const std::exception&) { _exit(1); }
+		_exit(0);
+	}
+	// created after the shm fork, so the shm robot holds no pipe ends
+	int pipeOut, pipeIn;
+	pid_t pipeChild = spawnPipeRobot(pipeOut, pipeIn);
+	if (pipeChild < 0) {
+		std::perror("fork");
+		kill(shmChild, SIGTERM);
+		waitpid(shmChild, nullptr, 0);
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	try {
+		ShmChannel shm(rings.requests(), rings.responses(), shmChild);
+		PipeChannel pipes(pipeOut, pipeIn);
+		RemoteRobotAdapter shmRobot(shm), pipeRobot(pipes);
+
+		std::cout << "The Robot in another process" << std::endl;
+		shmRobot.assignDriver("C-3PO");
+		shmRobot.driveForward();
+		shmRobot.fireWeapon();
+		std::cout << std::endl;
+
+		measure("shared memory: ", shmRobot);
+		measure("pipe:          ", pipeRobot);
+	}
+	catch (const std::exception& e) {
+		std::cout << "robot lost: " << e.what() << std::endl;
+		status = EXIT_FAILURE;
+	}
+	close(pipeOut);
+	close(pipeIn);
+	waitpid(shmChild, nullptr, 0);
+	waitpid(pipeChild, nullptr, 0);
+
+	bool detected = deadPipeRobotThrows();
+	std::cout << "dead pipe robot detected: " << (detected ? "yes" : "NO") << std::endl;
+	if (!detected)
+		status = EXIT_FAILURE;
+	return status;
+}
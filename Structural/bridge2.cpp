@@ -1,14 +1,69 @@
 /*
 Inspired by https://sourcemaking.com/design_patterns/bridge
+
+ThreadScheduler is the abstraction clients use to run tasks: submit(task)
+adds a task to a TaskGroup (tasks may submit more tasks), wait(group) returns
+once the whole group has finished and lets the calling thread run tasks in
+the meantime. The abstraction only counts tasks; how they run is up to the
+ThreadScheduler_Implementor behind the bridge:
+
+ - UnixPTS is a pthread pool with one Chase-Lev deque per worker. A worker
+   pushes and pops at the bottom of its own deque and steals from the top of
+   a random victim when it runs dry; idle workers park on a futex.
+ - SharedQueuePTS is the simple alternative: one mutex-protected queue for
+   all workers. It is kept to compare against.
+ - WindowsPTS stands in for a port and runs each task on the calling thread.
 */
 #include <iostream>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <climits>
+#include <stdexcept>
+#include <system_error>
+#include <cstdint>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+
+typedef std::function<void()> Task;
+
+/* Tasks that are waited for together */
+struct TaskGroup
+{
+    std::atomic<std::uint32_t> pending{0};
+};
+
+/* A submitted task as the implementors see it */
+struct Job
+{
+    Task task;
+    TaskGroup* group;
+};
 
 // Defines the Abstract Interface
 // Maintains the Implementor reference.
 class ThreadScheduler
 {
     public:
+        virtual ~ThreadScheduler() {}
         virtual void operation() = 0;
+        /* runs task asynchronously as part of group; may be called from tasks */
+        virtual void submit(Task task, TaskGroup& group) = 0;
+        virtual void submit(Task task) = 0;
+        /* returns once every task of the group has finished */
+        virtual void wait(TaskGroup& group) = 0;
+        virtual void wait() = 0;
 };
 
 // Implementator Interface for internal implementation that Bridge uses.
@@ -16,7 +71,25 @@ class ThreadScheduler
 class ThreadScheduler_Implementor
 {
     public:
+        virtual ~ThreadScheduler_Implementor() {}
         virtual void operationImp() = 0;
+        /* takes ownership of job and runs it with run() */
+        virtual void spawnImp(Job* job) = 0;
+        /* runs jobs on the calling thread or blocks until group.pending is 0 */
+        virtual void waitImp(TaskGroup& group) = 0;
+    protected:
+        /* runs and deletes job; the group must not be touched after its
+           count drops, a waiter may already have destroyed it */
+        void run(Job* job)
+        {
+            job->task();
+            TaskGroup* group = job->group;
+            delete job;
+            if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                groupDrained();
+        }
+        /* some group reached zero */
+        virtual void groupDrained() {}
 };
 
 // Realization/Implementation of ThreadScheduler (UML Abstraction1)
@@ -25,8 +98,17 @@ class Bridge : public ThreadScheduler
 {
     protected:
         ThreadScheduler_Implementor* imp;
+        TaskGroup all;      // group of submit(task)
     public:
         Bridge(ThreadScheduler_Implementor* backend) { imp = backend; }
+        void submit(Task task, TaskGroup& group) override
+        {
+            group.pending.fetch_add(1, std::memory_order_relaxed);
+            imp->spawnImp(new Job{ std::move(task), &group });
+        }
+        void submit(Task task) override { submit(std::move(task), all); }
+        void wait(TaskGroup& group) override { imp->waitImp(group); }
+        void wait() override { wait(all); }
 };
 
 /* Different special cases of the interface. */
@@ -59,15 +141,434 @@ class WindowsPTS : public ThreadScheduler_Implementor
 {
     public:
         void operationImp() { std::cout << "WindowsPTS" << std::endl; }
+        void spawnImp(Job* job) { run(job); }
+        void waitImp(TaskGroup&) {}     // nothing can still be running
+};
+
+static long futex(std::atomic<std::uint32_t>& word, int op, std::uint32_t value)
+{
+    return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), op, value, nullptr, nullptr, 0);
+}
+
+/* Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+   Work-Stealing for Weak Memory Models"). push/pop by the owner only. */
+class ChaseLevDeque
+{
+    public:
+        ChaseLevDeque() : array(new Array(1024))
+        {
+            arrays.emplace_back(array.load());
+        }
+        void push(Job* job)
+        {
+            long b = bottom.load(std::memory_order_relaxed);
+            long t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->capacity - 1)
+                a = grow(a, t, b);
+            a->put(b, job);
+            bottom.store(b + 1, std::memory_order_release);
+        }
+        Job* pop()
+        {
+            long b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long t = top.load(std::memory_order_relaxed);
+            if (t > b)
+            {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Job* job = a->get(b);
+            if (t == b)
+            {
+                /* last one: race the thieves for it */
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    job = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+        Job* steal()
+        {
+            long t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            long b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return nullptr;
+            Job* job = array.load(std::memory_order_acquire)->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return nullptr;
+            return job;
+        }
+        bool empty() const
+        {
+            return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+        }
+    private:
+        struct Array
+        {
+            explicit Array(long capacity) : capacity(capacity), slots(new std::atomic<Job*>[capacity]) {}
+            Job* get(long i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(long i, Job* job) { slots[i & (capacity - 1)].store(job, std::memory_order_relaxed); }
+            long capacity;
+            std::unique_ptr<std::atomic<Job*>[]> slots;
+        };
+        /* thieves may still read the old array; it is kept until the deque dies */
+        Array* grow(Array* a, long t, long b)
+        {
+            Array* bigger = new Array(a->capacity * 2);
+            for (long i = t; i < b; i++)
+                bigger->put(i, a->get(i));
+            arrays.emplace_back(bigger);
+            array.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+        alignas(64) std::atomic<long> top{0};
+        alignas(64) std::atomic<long> bottom{0};
+        std::atomic<Array*> array;
+        std::vector<std::unique_ptr<Array>> arrays;
 };
+
 class UnixPTS : public ThreadScheduler_Implementor
 {
     public:
+        explicit UnixPTS(unsigned threads = std::max(1u, (unsigned)sysconf(_SC_NPROCESSORS_ONLN)))
+            : deques(threads), workers(threads)
+        {
+            if (threads == 0)
+                throw std::invalid_argument("UnixPTS needs at least one thread");
+            for (unsigned i = 0; i < threads; i++)
+                starts.push_back(Start{ this, i });
+            for (unsigned i = 0; i < threads; i++)
+                if (int error = pthread_create(&workers[i], nullptr, &UnixPTS::main, &starts[i]))
+                {
+                    /* only the first i workers exist; stop them before failing */
+                    stop(i);
+                    throw std::system_error(error, std::generic_category(), "pthread_create");
+                }
+        }
+        ~UnixPTS() { stop(workers.size()); }
         void operationImp() { std::cout << "UnixPTS!" << std::endl; }
+
+        void spawnImp(Job* job)
+        {
+            if (self.pool == this)
+                deques[self.index].push(job);
+            else
+            {
+                std::lock_guard<std::mutex> lock(inboxMutex);
+                inbox.push_back(job);
+                inboxSize.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (idle.load(std::memory_order_relaxed) > 0)
+            {
+                workSignal.fetch_add(1, std::memory_order_relaxed);
+                futex(workSignal, FUTEX_WAKE_PRIVATE, 1);
+            }
+        }
+        void waitImp(TaskGroup& group)
+        {
+            std::uint64_t seed = reinterpret_cast<std::uintptr_t>(&group);
+            int misses = 0;
+            while (group.pending.load(std::memory_order_acquire) != 0)
+            {
+                if (Job* job = findWork(seed))
+                {
+                    run(job);
+                    misses = 0;
+                    continue;
+                }
+                if (++misses < 64)
+                {
+                    sched_yield();
+                    continue;
+                }
+                /* the rest of the group runs elsewhere; sleep until a group drains */
+                std::uint32_t seen = drained.load();
+                parked.fetch_add(1, std::memory_order_seq_cst);
+                if (group.pending.load(std::memory_order_seq_cst) != 0)
+                    futex(drained, FUTEX_WAIT_PRIVATE, seen);
+                parked.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+    private:
+        /* wakes and joins workers[0, started) */
+        void stop(std::size_t started)
+        {
+            stopping.store(true);
+            workSignal.fetch_add(1);
+            futex(workSignal, FUTEX_WAKE_PRIVATE, INT_MAX);
+            for (std::size_t i = 0; i < started; i++)
+                pthread_join(workers[i], nullptr);
+        }
+
+        struct Start { UnixPTS* pool; unsigned index; };
+        struct Self { UnixPTS* pool = nullptr; unsigned index = 0; };
+        static thread_local Self self;
+
+        static void* main(void* arg)
+        {
+            Start* start = static_cast<Start*>(arg);
+            self = Self{ start->pool, start->index };
+            start->pool->work();
+            return nullptr;
+        }
+        void work()
+        {
+            std::uint64_t seed = self.index * 0x9e3779b97f4a7c15 + 1;
+            int misses = 0;
+            while (!stopping.load(std::memory_order_relaxed))
+            {
+                if (Job* job = findWork(seed))
+                {
+                    run(job);
+                    misses = 0;
+                    continue;
+                }
+                if (++misses < 64)
+                {
+                    sched_yield();
+                    continue;
+                }
+                /* announce, look once more, then park until new work */
+                std::uint32_t seen = workSignal.load();
+                idle.fetch_add(1, std::memory_order_seq_cst);
+                if (!stopping.load() && !workVisible())
+                    futex(workSignal, FUTEX_WAIT_PRIVATE, seen);
+                idle.fetch_sub(1, std::memory_order_relaxed);
+                misses = 0;
+            }
+        }
+        /* own deque, then the inbox, then random victims */
+        Job* findWork(std::uint64_t& seed)
+        {
+            if (self.pool == this)
+                if (Job* job = deques[self.index].pop())
+                    return job;
+            if (inboxSize.load(std::memory_order_relaxed) > 0)
+            {
+                std::lock_guard<std::mutex> lock(inboxMutex);
+                if (!inbox.empty())
+                {
+                    Job* job = inbox.front();
+                    inbox.pop_front();
+                    inboxSize.fetch_sub(1, std::memory_order_relaxed);
+                    return job;
+                }
+            }
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            std::size_t n = deques.size();
+            for (std::size_t k = 0, first = seed % n; k < n; k++)
+            {
+                std::size_t victim = (first + k) % n;
+                if (self.pool == this && victim == self.index)
+                    continue;
+                if (Job* job = deques[victim].steal())
+                    return job;
+            }
+            return nullptr;
+        }
+        bool workVisible()
+        {
+            if (inboxSize.load(std::memory_order_seq_cst) > 0)
+                return true;
+            for (ChaseLevDeque& d : deques)
+                if (!d.empty())
+                    return true;
+            return false;
+        }
+        void groupDrained()
+        {
+            drained.fetch_add(1, std::memory_order_seq_cst);
+            if (parked.load(std::memory_order_seq_cst) > 0)
+                futex(drained, FUTEX_WAKE_PRIVATE, INT_MAX);
+        }
+
+        std::vector<ChaseLevDeque> deques;
+        std::vector<pthread_t> workers;
+        std::vector<Start> starts;
+        std::mutex inboxMutex;
+        std::deque<Job*> inbox;                 // jobs submitted from outside the pool
+        std::atomic<long> inboxSize{0};
+        alignas(64) std::atomic<std::uint32_t> workSignal{0};
+        std::atomic<std::uint32_t> idle{0};
+        alignas(64) std::atomic<std::uint32_t> drained{0};
+        std::atomic<std::uint32_t> parked{0};
+        std::atomic<bool> stopping{false};
+};
+thread_local UnixPTS::Self UnixPTS::self;
+
+/* One queue and one lock for all workers */
+class SharedQueuePTS : public ThreadScheduler_Implementor
+{
+    public:
+        explicit SharedQueuePTS(unsigned threads)
+        {
+            for (unsigned i = 0; i < threads; i++)
+                workers.emplace_back([this] { work(); });
+        }
+        ~SharedQueuePTS()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                stopping = true;
+            }
+            hasWork.notify_all();
+            for (std::thread& t : workers)
+                t.join();
+        }
+        void operationImp() { std::cout << "SharedQueuePTS" << std::endl; }
+        void spawnImp(Job* job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                jobs.push_back(job);
+            }
+            hasWork.notify_one();
+        }
+        void waitImp(TaskGroup& group)
+        {
+            std::unique_lock<std::mutex> lock(m);
+            while (group.pending.load(std::memory_order_acquire) != 0)
+            {
+                if (jobs.empty())
+                {
+                    groupDone.wait(lock);
+                    continue;
+                }
+                Job* job = jobs.front();
+                jobs.pop_front();
+                lock.unlock();
+                run(job);
+                lock.lock();
+            }
+        }
+    private:
+        void work()
+        {
+            std::unique_lock<std::mutex> lock(m);
+            for (;;)
+            {
+                hasWork.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                Job* job = jobs.front();
+                jobs.pop_front();
+                lock.unlock();
+                run(job);
+                lock.lock();
+            }
+        }
+        void groupDrained()
+        {
+            { std::lock_guard<std::mutex> lock(m); }
+            groupDone.notify_all();
+        }
+
+        std::mutex m;
+        std::condition_variable hasWork, groupDone;
+        std::deque<Job*> jobs;
+        bool stopping = false;
+        std::vector<std::thread> workers;
 };
 
+/* Benchmarks */
+
+long serialFib(int n) { return n < 2 ? n : serialFib(n - 1) + serialFib(n - 2); }
+
+/* fork-join: one half as a task, the other on this thread */
+long fib(ThreadScheduler& s, int n)
+{
+    if (n < 18)
+        return serialFib(n);
+    long a, b;
+    TaskGroup group;
+    s.submit([&s, &a, n] { a = fib(s, n - 1); }, group);
+    b = fib(s, n - 2);
+    s.wait(group);
+    return a + b;
+}
+
+/* body(first, last) over [0, n) in tasks of grain indices */
+void parallelFor(ThreadScheduler& s, std::size_t n, std::size_t grain,
+                 const std::function<void(std::size_t, std::size_t)>& body)
+{
+    TaskGroup group;
+    for (std::size_t first = 0; first < n; first += grain)
+        s.submit([&body, first, last = std::min(n, first + grain)] { body(first, last); }, group);
+    s.wait(group);
+}
+
+/* Unbalanced tree: a node has 4 children with probability 0.24, else none */
+std::uint64_t mix(std::uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+void visit(ThreadScheduler& s, TaskGroup& group, std::atomic<long>& nodes, std::uint64_t id)
+{
+    std::uint64_t h = id;
+    for (int i = 0; i < 64; i++)     // per-node work
+        h = mix(h);
+    nodes.fetch_add(1, std::memory_order_relaxed);
+    if (h % 100 < 24)
+        for (std::uint64_t c = 1; c <= 4; c++)
+            s.submit([&s, &group, &nodes, child = mix(id * 4 + c)] { visit(s, group, nodes, child); }, group);
+}
+long treeWalk(ThreadScheduler& s, int roots)
+{
+    std::atomic<long> nodes{0};
+    TaskGroup group;
+    for (int r = 0; r < roots; r++)
+        s.submit([&s, &group, &nodes, r] { visit(s, group, nodes, mix(r)); }, group);
+    s.wait(group);
+    return nodes;
+}
+
+template <class Pool>
+void benchmark(const char* name, unsigned maxThreads)
+{
+    typedef std::chrono::steady_clock clock;
+    std::vector<double> x(1 << 24), y(x.size());
+    for (std::size_t i = 0; i < x.size(); i++)
+        x[i] = i * 0.001;
+    double base[3] = {};
+    for (unsigned threads = 1; ; threads = std::min(maxThreads, threads * 2))
+    {
+        Pool pool(threads);
+        PreemptiveThreadScheduler s(&pool);
+        double sec[3];
+        auto t0 = clock::now();
+        long f = fib(s, 34);
+        auto t1 = clock::now();
+        parallelFor(s, x.size(), 16384, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; i++)
+                y[i] = std::sqrt(x[i]) * std::sin(x[i]);
+        });
+        auto t2 = clock::now();
+        long nodes = treeWalk(s, 20000);
+        auto t3 = clock::now();
+        sec[0] = std::chrono::duration<double>(t1 - t0).count();
+        sec[1] = std::chrono::duration<double>(t2 - t1).count();
+        sec[2] = std::chrono::duration<double>(t3 - t2).count();
+        if (threads == 1)
+            std::copy(sec, sec + 3, base);
+        std::cout << name << threads << " threads: fib(34)=" << f << " " << sec[0] * 1e3
+                  << " ms (x" << base[0] / sec[0] << "), parallel-for " << sec[1] * 1e3
+                  << " ms (x" << base[1] / sec[1] << "), tree of " << nodes << " nodes "
+                  << sec[2] * 1e3 << " ms (x" << base[2] / sec[2] << ")" << std::endl;
+        if (threads == maxThreads)
+            break;
+    }
+}
 
-int main()
+int main(int argc, char* argv[])
 {
     ThreadScheduler *absIntUse = nullptr;
     ThreadScheduler_Implementor *osWindowsPTS = new WindowsPTS;
@@ -86,5 +587,40 @@ int main()
     absIntUse = new TimeSlicedThreadScheduler(osUnixPTS);
     absIntUse->operation();
 
+    // Same work through either implementor
+    for (ThreadScheduler_Implementor* os : { osWindowsPTS, osUnixPTS })
+    {
+        PreemptiveThreadScheduler scheduler(os);
+        std::atomic<long> sum{0};
+        for (long i = 1; i <= 100; i++)
+            scheduler.submit([&sum, i] { sum += i; });
+        scheduler.wait();
+        std::cout << "sum of 1..100 = " << sum << ", fib(30) = " << fib(scheduler, 30) << std::endl;
+    }
+    std::cout << std::endl;
+
+    /* scaling from 1 to argv[1] (default: all cores) threads */
+    long maxThreads = std::max(1l, sysconf(_SC_NPROCESSORS_ONLN));
+    if (argc > 1)
+    {
+        char* end;
+        maxThreads = std::strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || maxThreads < 1 || maxThreads > 4096)
+        {
+            std::cout << "usage: " << argv[0] << " [max threads, 1..4096]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    try
+    {
+        benchmark<UnixPTS>("work stealing, ", maxThreads);
+        benchmark<SharedQueuePTS>("shared queue,  ", maxThreads);
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << "cannot start the pool: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }